@@ -24,6 +24,9 @@
 
 static cairo_surface_t *_atlases[__ATLAS_LAST];
 
+/* Downsampled textures atlases, per era. Level 0 is not stored here. */
+static cairo_surface_t *_mips[4][ATLAS_MIP_LEVELS - 1];
+
 static const char * _atlases_files[__ATLAS_LAST] =
 {
    [ATLAS_TILES_FOREST]         = "tiles/forest.png",
@@ -63,6 +66,21 @@ atlas_shutdown(void)
  *                                 Public API                                 *
  *============================================================================*/
 
+static void
+_atlas_mips_free(Pud_Era era)
+{
+   unsigned int i;
+
+   for (i = 0; i < EINA_C_ARRAY_LENGTH(_mips[era]); ++i)
+     {
+        if (_mips[era][i])
+          {
+             cairo_surface_destroy(_mips[era][i]);
+             _mips[era][i] = NULL;
+          }
+     }
+}
+
 Eina_Bool
 atlas_open(Atlas atlas)
 {
@@ -105,6 +123,8 @@ atlas_close(Atlas atlas)
         cairo_surface_destroy(_atlases[atlas]);
         _atlases[atlas] = NULL;
      }
+   if (atlas <= ATLAS_TILES_SWAMP)
+     _atlas_mips_free((Pud_Era)atlas);
 }
 
 cairo_surface_t *
@@ -162,6 +182,38 @@ atlas_texture_get(Pud_Era era)
    return _atlases[era];
 }
 
+cairo_surface_t *
+atlas_texture_mip_get(Pud_Era      era,
+                      unsigned int level)
+{
+   cairo_surface_t *parent, *surf;
+
+   EINA_SAFETY_ON_TRUE_RETURN_VAL((unsigned) era > PUD_ERA_SWAMP, NULL);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(level >= ATLAS_MIP_LEVELS, NULL);
+
+   if (level == 0) return _atlases[era];
+   if (_mips[era][level - 1]) return _mips[era][level - 1];
+
+   /*
+    * Levels are generated once, from the previous one. Textures are
+    * aligned on 32 pixels, so a 2x2 block never crosses two textures.
+    */
+   parent = atlas_texture_mip_get(era, level - 1);
+   if (EINA_UNLIKELY(!parent)) return NULL;
+
+   surf = blit_surface_downsample(parent);
+   if (EINA_UNLIKELY(!surf))
+     {
+        CRI("Failed to generate level %u of atlas for era %s",
+            level, pud_era_to_string(era));
+        return NULL;
+     }
+   DBG("Generated level %u of atlas for era %s", level, pud_era_to_string(era));
+   _mips[era][level - 1] = surf;
+
+   return surf;
+}
+
 cairo_surface_t *
 atlas_icon_get(Pud_Era era)
 {
@@ -176,6 +228,13 @@ atlas_texture_open(Pud_Era era)
    return atlas_open((Atlas)era);
 }
 
+void
+atlas_texture_close(Pud_Era era)
+{
+   EINA_SAFETY_ON_TRUE_RETURN((unsigned) era > PUD_ERA_SWAMP);
+   atlas_close((Atlas)era);
+}
+
 Eina_Bool
 atlas_icon_open(Pud_Era era)
 {
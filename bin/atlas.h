@@ -28,6 +28,9 @@
 #define ICON_WIDTH 46
 #define ICON_HEIGHT 38
 
+/* Level 0 is the original texture. Level N has textures of 32 >> N px */
+#define ATLAS_MIP_LEVELS 4
+
 typedef enum
 {
    ATLAS_TILES_FOREST           = 0,
@@ -50,6 +53,7 @@ void atlas_close(Atlas atlas);
 cairo_surface_t *atlas_get(Atlas atlas);
 
 cairo_surface_t *atlas_texture_get(Pud_Era era);
+cairo_surface_t *atlas_texture_mip_get(Pud_Era era, unsigned int level);
 cairo_surface_t *atlas_icon_get(Pud_Era era);
 Eina_Bool
 atlas_texture_access_test(uint16_t         tile,
@@ -58,6 +62,7 @@ atlas_texture_access_test(uint16_t         tile,
                           unsigned int    *y_off);
 
 Eina_Bool atlas_texture_open(Pud_Era era);
+void atlas_texture_close(Pud_Era era);
 Eina_Bool atlas_icon_open(Pud_Era era);
 
 cairo_surface_t *
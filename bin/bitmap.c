@@ -30,6 +30,21 @@
 #define MSG_STATE_ID    3
 #define MSG_VISIBLE_ID  4
 
+/* Tiles are 12 bits long: this value can never be a valid tile */
+#define BITMAP_TERRAIN_INVALID ((uint16_t) 0xffff)
+
+/* Biggest footprint of a unit (in cells), and how many cells a sprite
+ * may overflow its footprint */
+#define BITMAP_UNIT_SPREAD_MAX 4
+#define BITMAP_UNIT_OVERFLOW   1
+
+/* Refreshes smaller than this (in cells) don't render tiles in parallel */
+#define BITMAP_PARALLEL_CELLS_MIN 1024
+#define BITMAP_PARALLEL_BAND_MIN  4
+
+/* Bound of the tile propagation, in visits per cell of the map */
+#define BITMAP_PROPAGATION_VISITS_MAX 16
+
 /*============================================================================*
  *                                 Private API                                *
  *============================================================================*/
@@ -124,8 +139,10 @@ _calculate_wall_at(Editor       *ed,
 
    bc = &(ed->cells[y][x]);
 
+   /* Neighbours are modified before bitmap_tile_set() touches them */
 #define _WALL_SET(X, Y, W1, W2) \
    do { \
+      snapshot_cell_touch(ed, X, Y); \
       c = &(ed->cells[Y][X]); \
       if (tile_wall_is(c->tile_tl, c->tile_tr, c->tile_bl, c->tile_br)) { \
          if (_wall_same_race_is(bc->tile_ ## W1, c->tile_ ## W2)) { \
@@ -160,66 +177,80 @@ _calculate_wall_at(Editor       *ed,
                    bc->tile_bl, bc->tile_br, 0, EINA_TRUE);
 
    EINA_RECTANGLE_SET(&zone, x - 1, y - 1, 3, 3);
-   bitmap_refresh(ed, &zone);
+   bitmap_refresh_schedule(ed, &zone);
 }
 
-static void
-_place_wall(Editor       *ed,
-            unsigned int  x,
-            unsigned int  y,
-            uint8_t       wall)
+/*
+ * A side of a wall is open when it faces a wall of the same race, and
+ * closed otherwise.
+ */
+static uint8_t
+_wall_side_get(const Editor *ed,
+               uint8_t       side,
+               int           nx,
+               int           ny)
 {
-   bitmap_tile_set(ed, x, y, wall, wall, wall, wall, 0, EINA_TRUE);
-   _calculate_wall_at(ed, x, y);
+   const Cell *n;
+
+   if ((nx < 0) || (ny < 0) ||
+       (nx >= (int)ed->pud->map_w) || (ny >= (int)ed->pud->map_h))
+     return _wall_close(side);
+
+   n = &(ed->cells[ny][nx]);
+   if (TILE_WALL_IS(n) && _wall_same_race_is(side, n->tile_tl))
+     return _wall_open(side);
+   return _wall_close(side);
 }
 
 static void
-_place_selected_tile(Editor           *ed,
-                     const Editor_Sel  action,
-                     const Editor_Sel  spread,
-                     const Editor_Sel  tint,
-                     unsigned int      x,
-                     unsigned int      y)
-{
-   uint8_t component;
-   uint8_t randomize = TILE_RANDOMIZE;
+_wall_sides_update(Editor *ed,
+                   int     x,
+                   int     y)
+{
    const Cell *c;
-   unsigned int i, passes;
+   uint8_t tl, tr, bl, br;
 
-   if ((x >= ed->pud->map_w) || (y >= ed->pud->map_h))
+   if ((x < 0) || (y < 0) ||
+       (x >= (int)ed->pud->map_w) || (y >= (int)ed->pud->map_h))
      return;
    c = &(ed->cells[y][x]);
+   if (!TILE_WALL_IS(c))
+     return;
 
-   if (spread == EDITOR_SEL_SPREAD_SPECIAL)
-     randomize |= TILE_SPECIAL;
+   /* Same rotation as above: TL, TR, BL, BR face top, right, bottom, left */
+   tl = _wall_side_get(ed, c->tile_tl, x, y - 1);
+   tr = _wall_side_get(ed, c->tile_tr, x + 1, y);
+   bl = _wall_side_get(ed, c->tile_bl, x, y + 1);
+   br = _wall_side_get(ed, c->tile_br, x - 1, y);
 
-   component = _solid_component_get(action, tint);
-   if (tile_wall_is(component, component, component, component))
-     {
-        _place_selected_tile(ed, EDITOR_SEL_ACTION_GRASS,
-                             EDITOR_SEL_SPREAD_NORMAL,
-                             EDITOR_SEL_TINT_LIGHT,
-                             x, y);
-        _place_wall(ed, x, y, component);
-        return;
-     }
+   if ((tl != c->tile_tl) || (tr != c->tile_tr) ||
+       (bl != c->tile_bl) || (br != c->tile_br))
+     bitmap_tile_set(ed, x, y, tl, tr, bl, br, 0, EINA_TRUE);
+}
 
-   /*
-    * XXX This is a bit of a hack.
-    * Placing dark grass or forest in dark water will
-    * cause the center tile to be messed up.
-    * This can be easily solved by applying the same tile
-    * at the same point.
-    * This is not pretty, but is simple to fix.
-    * Maybe later, propose something better...
-    */
-   passes = (TILE_DARK_WATER_IS(c)) ? 2 : 1;
-   for (i = 0; i < passes; i++)
+static void
+_wall_segment_end(Editor *ed)
+{
+   const Editor_Sel action = editor_sel_action_get(ed);
+
+   if (ed->wall_from.x < 0)
+     return;
+
+   if ((ed->prev_x >= 0) &&
+       ((action == EDITOR_SEL_ACTION_ORC_WALLS) ||
+        (action == EDITOR_SEL_ACTION_HUMAN_WALLS)))
      {
-        bitmap_tile_set(ed, x, y, component, component,
-                        component, component, randomize, EINA_TRUE);
-        bitmap_tile_calculate(ed, x, y, NULL);
+        snapshot_push(ed);
+        bitmap_wall_segment_set(ed, ed->wall_from.x, ed->wall_from.y,
+                                ed->prev_x, ed->prev_y,
+                                _solid_component_get(action,
+                                                     editor_sel_tint_get(ed)));
+        snapshot_push_done(ed);
+        editor_changed(ed);
      }
+
+   ed->wall_from.x = -1;
+   ed->wall_from.y = -1;
 }
 
 static void
@@ -231,6 +262,8 @@ _click_handle(Editor *ed,
    int w, h;
    Eina_Rectangle zone;
    Editor_Sel action, spread;
+   uint8_t component, randomize;
+   uint8_t *mask;
    int z, i, j;
    Unit type = UNIT_NONE;
 
@@ -247,6 +280,8 @@ _click_handle(Editor *ed,
    action = editor_sel_action_get(ed);
    if (ed->sel_unit != PUD_UNIT_NONE)
      {
+        /* Moving a start location is part of the same edit */
+        snapshot_push(ed);
         if (pud_unit_start_location_is(ed->sel_unit))
           {
              const int lx = ed->start_locations[ed->sel_player].x;
@@ -254,12 +289,15 @@ _click_handle(Editor *ed,
 
              if (ed->start_locations[ed->sel_player].x != -1)
                {
+                  if (!unitindex_bbox_get(ed, lx, ly, UNIT_START_LOCATION, &zone))
+                    EINA_RECTANGLE_SET(&zone, lx, ly, 1, 1);
+                  unitindex_del(ed, lx, ly, UNIT_START_LOCATION);
+                  snapshot_cell_touch(ed, lx, ly);
                   ed->cells[ly][lx].unit_below = PUD_UNIT_NONE;
                   ed->cells[ly][lx].start_location = CELL_NOT_START_LOCATION;
                   editor_unit_unref(ed, lx, ly, UNIT_START_LOCATION);
                   minimap_update(ed, lx, ly);
-                  EINA_RECTANGLE_SET(&zone, lx - 1, ly - 1, 3, 3);
-                  bitmap_refresh(ed, &zone);
+                  bitmap_refresh_schedule(ed, &zone);
                }
 
              ed->start_locations[ed->sel_player].x = x;
@@ -267,10 +305,9 @@ _click_handle(Editor *ed,
           }
 
         /* Draw the unit, and therefore lock the cursor. */
-        orient = sprite_info_random_get();
+        orient = sprite_info_random_get(&(ed->prng));
 
         bitmap_cursor_size_get(ed, &w, &h);
-        snapshot_push(ed);
         type = bitmap_unit_set(ed, ed->sel_unit, ed->sel_player,
                                orient, x, y, w, h,
                                editor_alter_defaults_get(ed, ed->sel_unit));
@@ -278,10 +315,21 @@ _click_handle(Editor *ed,
         editor_unit_ref(ed, x, y, type);
         minimap_render_unit(ed, x, y, ed->sel_unit);
         bitmap_cursor_enabled_set(ed, EINA_FALSE);
-        EINA_RECTANGLE_SET(&zone, x - 6, y - 6, 12, 12); // XXX Zone is random
-        bitmap_refresh(ed, &zone);
+        /* Exactly the cells covered by the sprite */
+        if (!unitindex_bbox_get(ed, x, y, type, &zone))
+          EINA_RECTANGLE_SET(&zone, x, y, w, h);
+        bitmap_refresh_schedule(ed, &zone);
         editor_changed(ed);
      }
+   else if (action == EDITOR_SEL_ACTION_FILL)
+     {
+        component = _solid_component_get(ed->fill_action,
+                                         editor_sel_tint_get(ed));
+        snapshot_push(ed);
+        if (bitmap_fill(ed, x, y, component, TILE_RANDOMIZE))
+          editor_changed(ed);
+        snapshot_push_done(ed);
+     }
    else if (action != EDITOR_SEL_ACTION_SELECTION)
      {
         switch (editor_sel_radius_get(ed))
@@ -304,26 +352,47 @@ _click_handle(Editor *ed,
               break;
           }
 
-        /* Walls are special and cannot be created as big */
+        /*
+         * Walls are drawn by segments: the first cell is the anchor,
+         * and the segment is laid when the button is released.
+         */
         if ((action == EDITOR_SEL_ACTION_ORC_WALLS) ||
             (action == EDITOR_SEL_ACTION_HUMAN_WALLS))
           {
-             z = 0;
+             if (ed->wall_from.x < 0)
+               {
+                  ed->wall_from.x = x;
+                  ed->wall_from.y = y;
+               }
+             return;
           }
 
         spread = editor_sel_spread_get(ed);
+        component = _solid_component_get(action, editor_sel_tint_get(ed));
+
+        /* The whole brush is one transaction */
+        EINA_RECTANGLE_SET(&zone, x - z, y - z, 2 * z + 1, 2 * z + 1);
+        mask = NULL;
+        if ((spread == EDITOR_SEL_SPREAD_CIRCLE) && (z > 0))
+          {
+             mask = malloc(zone.w * zone.h);
+             if (EINA_UNLIKELY(!mask))
+               {
+                  CRI("Failed to allocate memory");
+                  return;
+               }
+             for (j = -z; j <= z; j++)
+               for (i = -z; i <= z; i++)
+                 mask[(j + z) * zone.w + (i + z)] = (abs(i * j) < z);
+          }
+        randomize = TILE_RANDOMIZE;
+        if (spread == EDITOR_SEL_SPREAD_SPECIAL)
+          randomize |= TILE_SPECIAL;
+
         snapshot_push(ed);
-        for (j = -z; j <= z; j++)
-          for (i = -z; i <= z; i++)
-            {
-               if (spread == EDITOR_SEL_SPREAD_CIRCLE)
-                 {
-                    if ((z > 0) && (abs(i * j) >= z)) continue;
-                 }
-               _place_selected_tile(ed, action, spread,
-                                    editor_sel_tint_get(ed), x + i, y + j);
-            }
+        bitmap_tiles_impose(ed, &zone, mask, component, randomize, NULL);
         snapshot_push_done(ed);
+        free(mask);
         editor_changed(ed);
      }
 }
@@ -636,6 +705,7 @@ _bitmap_autoresize(Editor *ed)
    evas_object_resize(ed->bitmap.clip, w, h);
 
    bitmap_minimap_view_resize(ed);
+   chunks_viewport_update(ed);
 }
 
 static void
@@ -647,6 +717,30 @@ _bitmap_resize_cb(void        *data,
    _bitmap_autoresize(data);
 }
 
+static Eina_Bool
+_bitmap_refresh_frame_cb(void *data)
+{
+   Editor *const ed = data;
+
+   ed->bitmap.pending.animator = NULL;
+   bitmap_refresh_flush(ed);
+
+   return ECORE_CALLBACK_CANCEL;
+}
+
+static void
+_bitmap_refresh_cancel(Editor *ed)
+{
+   if (ed->bitmap.pending.animator)
+     {
+        ecore_animator_del(ed->bitmap.pending.animator);
+        ed->bitmap.pending.animator = NULL;
+     }
+   EINA_RECTANGLE_SET(&(ed->bitmap.pending.zone), 0, 0, 0, 0);
+   ed->bitmap.pending.requests = 0;
+   ed->bitmap.pending.full = EINA_FALSE;
+}
+
 
 /*============================================================================*
  *                                   Events                                   *
@@ -665,7 +759,7 @@ _mouse_move_cb(void        *data,
    /* Disable mouse move callback actions when the menu is there */
    if (ed->menu_in_out_cache.menu_in) return;
 
-   evas_object_geometry_get(ed->bitmap.img, &ox, &oy, NULL, NULL);
+   evas_object_geometry_get(ed->bitmap.grid, &ox, &oy, NULL, NULL);
    bitmap_coords_to_cells(ed, ev->cur.canvas.x - ox, ev->cur.canvas.y - oy, &cx, &cy);
 
    bitmap_cursor_move(ed, cx, cy);
@@ -719,7 +813,9 @@ _mouse_move_cb(void        *data,
           bitmap_cursor_enabled_set(ed, EINA_TRUE);
      }
 
-   if (bitmap_cursor_enabled_get(ed))
+   /* The bucket fills once, when the button is pressed */
+   if (bitmap_cursor_enabled_get(ed) &&
+       (editor_sel_action_get(ed) != EDITOR_SEL_ACTION_FILL))
      {
         if (ev->buttons & 1)
           _click_handle(ed, cx, cy);
@@ -737,7 +833,7 @@ _mouse_down_cb(void        *data,
    int cx, cy;
    int ox, oy;
 
-   evas_object_geometry_get(ed->bitmap.img, &ox, &oy, NULL, NULL);
+   evas_object_geometry_get(ed->bitmap.grid, &ox, &oy, NULL, NULL);
    bitmap_coords_to_cells(ed, ev->canvas.x - ox, ev->canvas.y - oy, &cx, &cy);
 
    if (ev->button == 1) /* Left button */
@@ -775,6 +871,7 @@ _mouse_up_cb(void        *data,
    if (sel_active_is(ed))
      sel_end(ed);
 
+   _wall_segment_end(ed);
    ed->prev_x = -1;
    ed->prev_y = -1;
 }
@@ -811,9 +908,9 @@ bitmap_debug_cell(Editor       *ed,
    else
      cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
 
-   cairo_move_to(cr, x * TEXTURE_WIDTH, y * TEXTURE_HEIGHT + ext1.height);
+   cairo_move_to(cr, x * ed->bitmap.cell_w, y * ed->bitmap.cell_h + ext1.height);
    cairo_show_text(cr, msg1);
-   cairo_move_to(cr, x * TEXTURE_WIDTH, y * TEXTURE_HEIGHT + ext1.height + ext2.height + 3);
+   cairo_move_to(cr, x * ed->bitmap.cell_w, y * ed->bitmap.cell_h + ext1.height + ext2.height + 3);
    cairo_show_text(cr, msg2);
 #else
    (void) ed;
@@ -822,6 +919,59 @@ bitmap_debug_cell(Editor       *ed,
 #endif
 }
 
+void
+bitmap_debug_hud_update(Editor *ed)
+{
+   uint64_t now[__STATS_LAST], d[__STATS_LAST];
+   Evas_Object *o = ed->hud.text;
+   char buf[256];
+   int x, y;
+   unsigned int i;
+   size_t undo, redo;
+
+   if (!o)
+     {
+        o = ed->hud.text = evas_object_text_add(evas_object_evas_get(ed->win));
+        evas_object_text_font_set(o, "Sans", 10);
+        evas_object_text_style_set(o, EVAS_TEXT_STYLE_OUTLINE);
+        evas_object_text_outline_color_set(o, 0, 0, 0, 255);
+        evas_object_color_set(o, 255, 255, 255, 255);
+        evas_object_pass_events_set(o, EINA_TRUE);
+        evas_object_layer_set(o, EVAS_LAYER_MAX - 1);
+        evas_object_show(o);
+     }
+
+   /*
+    * Counters are cumulative: show what changed since the last frame of
+    * this editor. They are global, so the work of all the editors is
+    * shown, and labelled as such. Only the undo history is this editor's.
+    */
+   stats_get(now);
+   snapshot_bytes_get(ed, &undo, &redo);
+   for (i = 0; i < __STATS_LAST; ++i)
+     {
+        d[i] = now[i] - ed->hud.last[i];
+        ed->hud.last[i] = now[i];
+     }
+
+   snprintf(buf, sizeof(buf),
+            "all editors: refresh %.2f ms | tiles %u | sprites %u | "
+            "recolor %u px | fills %u | minimap %u | upload %u KiB || "
+            "this editor: undo %u/%u KiB",
+            (double)d[STATS_REFRESH_USEC] / 1000.0,
+            (unsigned int)d[STATS_TILES], (unsigned int)d[STATS_SPRITES],
+            (unsigned int)d[STATS_RECOLOR_PIXELS], (unsigned int)d[STATS_FILLS],
+            (unsigned int)d[STATS_MINIMAP_CELLS],
+            (unsigned int)(d[STATS_UPLOAD_BYTES] / 1024),
+            (unsigned int)(undo / 1024), (unsigned int)(redo / 1024));
+   buf[sizeof(buf) - 1] = '\0';
+   evas_object_text_text_set(o, buf);
+
+   /* Top-left corner of the visible bitmap */
+   evas_object_geometry_get(ed->bitmap.clip, &x, &y, NULL, NULL);
+   evas_object_move(o, x + 4, y + 4);
+}
+
 void
 bitmap_unit_draw(Editor       *ed,
                  unsigned int  x,
@@ -832,11 +982,10 @@ bitmap_unit_draw(Editor       *ed,
    const Cell *c = &(cells[y][x]);
    Eina_Bool flip;
    int at_x, at_y;
-   unsigned int w, h, i;
+   unsigned int w, h;
    Pud_Unit unit = PUD_UNIT_NONE;
    Pud_Player col;
    unsigned int orient;
-   cairo_surface_t *surf;
    cairo_matrix_t mat;
    cairo_t *const cr = ed->bitmap.cr;
    Sprite_Descriptor *d;
@@ -885,35 +1034,22 @@ bitmap_unit_draw(Editor       *ed,
    if (unit == PUD_UNIT_NONE)
      return;
 
-   d = sprite_get(unit, ed->pud->era, orient, &flip);
+   d = sprite_get(unit, ed->pud->era, orient, col, &flip);
    if (EINA_UNLIKELY(!d))
      {
         CRI("Failed to get sprite 0x%x", unit);
         return;
      }
-
-   at_x = (x * TEXTURE_WIDTH) + ((int)(w * TEXTURE_WIDTH) - (int)d->w) / 2;
-   at_y = (y * TEXTURE_HEIGHT) + ((int)(h * TEXTURE_HEIGHT) - (int)d->h) / 2;
-
-   surf = cairo_image_surface_create_for_data(d->data, CAIRO_FORMAT_ARGB32, d->w, d->h,
-                                              cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, d->w));
-
-   /* Colorize source sprite */
-   if (d->color != col)
+   d = sprite_mip_get(d, ed->bitmap.zoom);
+   if (EINA_UNLIKELY(!d))
      {
-
-        const unsigned int pixels = cairo_image_surface_get_width(surf) *
-           cairo_image_surface_get_height(surf) * 4;
-        for (i = 0; i < pixels; i += 4)
-          {
-             war2_sprites_color_convert(d->color, col,
-                                        d->data[i + 2], d->data[i + 1], d->data[i + 0],
-                                        &d->data[i + 2], &d->data[i + 1], &d->data[i + 0]);
-          }
-        cairo_surface_mark_dirty(surf);
-        d->color = col;
+        CRI("Failed to get level %u of sprite 0x%x", ed->bitmap.zoom, unit);
+        return;
      }
 
+   at_x = (x * ed->bitmap.cell_w) + ((int)(w * ed->bitmap.cell_w) - (int)d->w) / 2;
+   at_y = (y * ed->bitmap.cell_h) + ((int)(h * ed->bitmap.cell_h) - (int)d->h) / 2;
+
    if (flip)
      {
         cairo_matrix_init(&mat,
@@ -925,27 +1061,29 @@ bitmap_unit_draw(Editor       *ed,
      }
 
 
-   cairo_set_source_surface(cr, surf, at_x, at_y);
+   cairo_set_source_surface(cr, d->surf, at_x, at_y);
    cairo_rectangle(cr, at_x, at_y, d->w, d->h);
    cairo_fill(cr);
+   stats_add(STATS_SPRITES, 1);
+   stats_add(STATS_FILLS, 1);
 
    if (flip)
      {
         cairo_restore(cr);
      }
 
-   cairo_surface_destroy(surf);
-
    //DBG("Draw unit %s at_x=%i, at_y=%i", pud_unit_to_string(unit), at_x, at_y);
 }
 
 static void
-_draw_selection(cairo_t      *cr,
+_draw_selection(Editor       *ed,
                 unsigned int  x,
                 unsigned int  y,
                 unsigned int  spread)
 {
+   cairo_t *const cr = ed->bitmap.cr;
    cairo_surface_t *surf;
+   const double scale = 1.0 / (double)(1 << ed->bitmap.zoom);
 
    x *= TEXTURE_WIDTH;
    y *= TEXTURE_HEIGHT;
@@ -953,9 +1091,14 @@ _draw_selection(cairo_t      *cr,
    surf = sprite_selection_get(spread);
    spread *= TEXTURE_WIDTH;
 
+   /* Selections are thin strokes: they are scaled, not mipmapped */
+   cairo_save(cr);
+   cairo_scale(cr, scale, scale);
    cairo_set_source_surface(cr, surf, x, y);
    cairo_rectangle(cr, x, y, spread, spread);
    cairo_fill(cr);
+   cairo_restore(cr);
+   stats_add(STATS_FILLS, 1);
 }
 
 void
@@ -971,7 +1114,6 @@ bitmap_selections_draw(Editor       *ed,
    unsigned int y2 = y1 + h;
    unsigned int i, j;
    Cell *c;
-   cairo_t *const cr = ed->bitmap.cr;
 
    if (ed->sel.selections <= 0) return;
 
@@ -988,16 +1130,16 @@ bitmap_selections_draw(Editor       *ed,
             {
                if (c->anchor_below)
                  {
-                    _draw_selection(cr, i, j, c->spread_x_below);
+                    _draw_selection(ed, i, j, c->spread_x_below);
                  }
                else if (c->start_location != CELL_NOT_START_LOCATION)
                  {
-                    _draw_selection(cr, i, j, 1);
+                    _draw_selection(ed, i, j, 1);
                  }
             }
           if ((c->anchor_above) && (c->selected_above))
             {
-               _draw_selection(cr, i, j, c->spread_x_above);
+               _draw_selection(ed, i, j, c->spread_x_above);
             }
        }
 }
@@ -1049,10 +1191,12 @@ bitmap_unit_del_at(Editor       *ed,
            return;
      }
 
+   unitindex_del(ed, rx, ry, type);
    editor_unit_unref(ed, x, y, type);
    for (j = ry; j < ry + sy; ++j)
      for (i = rx; i < rx + sx; ++i)
        {
+          snapshot_cell_touch(ed, i, j);
           c = &(ed->cells[j][i]);
           switch (type)
             {
@@ -1121,6 +1265,7 @@ bitmap_unit_set(Editor       *ed,
 
    if (pud_unit_start_location_is(unit))
      {
+        snapshot_cell_touch(ed, x, y);
         c = &(ed->cells[y][x]);
         c->start_location = color;
         c->start_location_human = (unit == PUD_UNIT_HUMAN_START);
@@ -1136,6 +1281,7 @@ bitmap_unit_set(Editor       *ed,
              if ((i >= map_w) || (j >= map_h))
                break;
 
+             snapshot_cell_touch(ed, i, j);
              c = &(ed->cells[j][i]);
              if (flying)
                {
@@ -1177,40 +1323,199 @@ bitmap_unit_set(Editor       *ed,
      }
 
 end:
+   if (ret != UNIT_NONE)
+     unitindex_add(ed, x, y, ret);
    minimap_update(ed, x, y);
    return ret;
 }
 
-void
-bitmap_tile_draw(Editor       *ed,
-                 unsigned int  x,
-                 unsigned int  y)
+/*
+ * Copies the texture of a tile in the terrain layer, without telling cairo.
+ * Cells are independent, so this may be called from several threads at
+ * once. Returns the chunk that was written, NULL otherwise.
+ */
+static Chunk *
+_bitmap_tile_render(Editor          *ed,
+                    unsigned int     x,
+                    unsigned int     y,
+                    cairo_surface_t *atlas,
+                    cairo_surface_t *ref)
 {
-   cairo_surface_t *atlas;
    unsigned int ox, oy, px, py;
+   const unsigned int tw = ed->bitmap.cell_w;
+   const unsigned int th = ed->bitmap.cell_h;
+   uint16_t *const drawn = &(ed->bitmap.terrain.tiles[(y * ed->pud->map_w) + x]);
+   const uint16_t tile = ed->cells[y][x].tile;
+   unsigned char *dst;
+   const unsigned char *src;
+   int dst_stride, src_stride;
+   Chunk *chunk;
+
+   /* Terrain layer is already up-to-date */
+   if (*drawn == tile)
+     return NULL;
+
+   px = x * tw;
+   py = y * th;
+
+   /* The chunk is not resident: it will be drawn when it is loaded */
+   chunk = chunk_at(ed, px, py);
+   if (!chunk)
+     return NULL;
+
+   /* Offsets are computed in the full-size atlas */
+   if (EINA_UNLIKELY(!atlas_texture_access_test(tile, ref, &ox, &oy)))
+     {
+        ERR("Cannot map tile texture 0x%04x", tile);
+        return NULL;
+     }
+   ox >>= ed->bitmap.zoom;
+   oy >>= ed->bitmap.zoom;
 
-   atlas = atlas_texture_get(ed->pud->era);
-   if (EINA_UNLIKELY(!atlas))
+   if (EINA_UNLIKELY((ox + tw > (unsigned int)cairo_image_surface_get_width(atlas)) ||
+                     (oy + th > (unsigned int)cairo_image_surface_get_height(atlas))))
      {
-        ERR("Failed to get atlas for era %s", pud_era_to_string(ed->pud->era));
-        return;
+        ERR("Tile texture 0x%04x is out of the atlas", tile);
+        return NULL;
      }
 
-   if (EINA_UNLIKELY(!atlas_texture_access_test(ed->cells[y][x].tile, atlas, &ox, &oy)))
+   /* Tiles are opaque: this is a plain copy from the atlas */
+   dst_stride = cairo_image_surface_get_stride(chunk->terrain);
+   src_stride = cairo_image_surface_get_stride(atlas);
+   dst = cairo_image_surface_get_data(chunk->terrain) +
+      ((py - chunk->geo.y) * dst_stride) + ((px - chunk->geo.x) * 4);
+   src = cairo_image_surface_get_data(atlas) + (oy * src_stride) + (ox * 4);
+   blit_rect(dst, dst_stride, src, src_stride, tw, th);
+   stats_add(STATS_TILES, 1);
+
+   *drawn = tile;
+   return chunk;
+}
+
+static Eina_Bool
+_bitmap_atlases_get(const Editor     *ed,
+                    cairo_surface_t **atlas,
+                    cairo_surface_t **ref)
+{
+   *ref = atlas_texture_get(ed->pud->era);
+   *atlas = atlas_texture_mip_get(ed->pud->era, ed->bitmap.zoom);
+   if (EINA_UNLIKELY((!*atlas) || (!*ref)))
      {
-        ERR("Cannot map tile texture 0x%04x", ed->cells[y][x].tile);
-        return;
+        ERR("Failed to get atlas for era %s", pud_era_to_string(ed->pud->era));
+        return EINA_FALSE;
      }
+   cairo_surface_flush(*atlas);
+   cairo_surface_flush(*ref);
+   return EINA_TRUE;
+}
+
+typedef struct
+{
+   Editor          *ed;
+   cairo_surface_t *atlas;
+   cairo_surface_t *ref;
+   Eina_Rectangle   area;
+   unsigned int     band_h;
+} Bitmap_Terrain_Job;
+
+static void
+_bitmap_terrain_band_cb(void         *data,
+                        unsigned int  job)
+{
+   const Bitmap_Terrain_Job *const t = data;
+   const unsigned int y1 = t->area.y + (job * t->band_h);
+   const unsigned int y2 = MIN(y1 + t->band_h, (unsigned int)(t->area.y + t->area.h));
+   const unsigned int x2 = t->area.x + t->area.w;
+   unsigned int i, j;
+
+   for (j = y1; j < y2; ++j)
+     for (i = t->area.x; i < x2; ++i)
+       _bitmap_tile_render(t->ed, i, j, t->atlas, t->ref);
+}
+
+/*
+ * Big refreshes (whole view after loading, generating, rolling back or
+ * changing the era) are dominated by the tiles. The tile pass is split
+ * in row bands rendered in parallel: each cell is written by exactly one
+ * band, with the same copy as the serial path, so the output is the same.
+ */
+static void
+_bitmap_terrain_render(Editor               *ed,
+                       const Eina_Rectangle *area)
+{
+   Bitmap_Terrain_Job t;
+   unsigned int workers, bands;
+   Chunk *chunk;
+
+   workers = parallel_workers_get();
+   if ((workers <= 1) ||
+       ((unsigned int)(area->w * area->h) < BITMAP_PARALLEL_CELLS_MIN))
+     return;
+
+   if (!_bitmap_atlases_get(ed, &t.atlas, &t.ref))
+     return;
+
+   t.ed = ed;
+   t.area = *area;
+   /* More bands than workers, so they are balanced */
+   bands = workers * 2;
+   t.band_h = MAX((area->h + bands - 1) / bands, BITMAP_PARALLEL_BAND_MIN);
+   bands = (area->h + t.band_h - 1) / t.band_h;
+
+   EINA_INLIST_FOREACH(ed->bitmap.chunks.lru, chunk)
+     cairo_surface_flush(chunk->terrain);
+
+   parallel_run(bands, _bitmap_terrain_band_cb, &t);
+
+   EINA_INLIST_FOREACH(ed->bitmap.chunks.lru, chunk)
+     cairo_surface_mark_dirty(chunk->terrain);
+}
+
+void
+bitmap_tile_draw(Editor       *ed,
+                 unsigned int  x,
+                 unsigned int  y)
+{
+   cairo_surface_t *atlas, *ref;
+   Chunk *chunk;
+
+   /* Terrain layer is already up-to-date */
+   if (ed->bitmap.terrain.tiles[(y * ed->pud->map_w) + x] == ed->cells[y][x].tile)
+     return;
+
+   if (!_bitmap_atlases_get(ed, &atlas, &ref))
+     return;
+
+   chunk = _bitmap_tile_render(ed, x, y, atlas, ref);
+   if (chunk)
+     cairo_surface_mark_dirty_rectangle(chunk->terrain,
+                                        (x * ed->bitmap.cell_w) - chunk->geo.x,
+                                        (y * ed->bitmap.cell_h) - chunk->geo.y,
+                                        ed->bitmap.cell_w, ed->bitmap.cell_h);
+}
+
+void
+bitmap_terrain_invalidate(Editor               *ed,
+                          const Eina_Rectangle *zone)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   Eina_Rectangle area;
+   int i, j;
 
-   px = x * TEXTURE_WIDTH;
-   py = y * TEXTURE_HEIGHT;
+   if (!ed->bitmap.terrain.tiles) return;
 
-   cairo_set_source_surface(ed->bitmap.cr, atlas,
-                            (int)px - (int)ox, (int)py - (int)oy);
-   cairo_rectangle(ed->bitmap.cr, px, py, TEXTURE_WIDTH, TEXTURE_HEIGHT);
-   cairo_fill(ed->bitmap.cr);
+   EINA_RECTANGLE_SET(&area, 0, 0, map_w, ed->pud->map_h);
+   if (zone)
+     {
+        if (!eina_rectangle_intersection(&area, zone))
+          return;
+     }
+   else
+     ed->bitmap.terrain.era = ed->pud->era;
 
-   minimap_render(ed, x, y, 1, 1);
+   for (j = area.y; j < area.y + area.h; ++j)
+     for (i = area.x; i < area.x + area.w; ++i)
+       ed->bitmap.terrain.tiles[(j * map_w) + i] = BITMAP_TERRAIN_INVALID;
 }
 
 enum
@@ -1244,21 +1549,61 @@ _conflict_solve(uint8_t    imposed,
 }
 
 
-Eina_Bool
-bitmap_tile_calculate(Editor           *ed,
-                      int               px,
-                      int               py,
-                      Tile_Propagation *prop)
+static void
+_propagation_push(Editor         *ed,
+                  int             x,
+                  int             y,
+                  Tile_Propagate  prop)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const unsigned int size = map_w * ed->pud->map_h;
+   const unsigned int cell = (y * map_w) + x;
+   uint8_t *const pending = &(ed->bitmap.propagation.pending[cell]);
+
+   /* Already queued: it will propagate in all the requested directions */
+   if (*pending)
+     {
+        *pending |= prop;
+        return;
+     }
+
+   *pending = prop;
+   ed->bitmap.propagation.fifo[(ed->bitmap.propagation.head +
+                                ed->bitmap.propagation.count) % size] = cell;
+   ed->bitmap.propagation.count++;
+}
+
+static void
+_propagation_changed(Bitmap_Propagation *metrics,
+                     int                 x,
+                     int                 y)
+{
+   Eina_Rectangle r;
+
+   EINA_RECTANGLE_SET(&r, x, y, 1, 1);
+   if (eina_rectangle_is_empty(&(metrics->changed)))
+     metrics->changed = r;
+   else
+     eina_rectangle_union(&(metrics->changed), &r);
+}
+
+/*
+ * Solves the neighbours of a cell (only in the directions of prop),
+ * sets their tiles, and queues the ones that were in conflict: their own
+ * neighbours will have to be solved in turn.
+ */
+static Eina_Bool
+_propagation_solve(Editor             *ed,
+                   int                 x,
+                   int                 y,
+                   Tile_Propagate      current_prop,
+                   Bitmap_Propagation *metrics)
 {
    Cell *const *const cells = ed->cells;
    Eina_Bool ok = EINA_TRUE;
    Tile_Propagation next[8];
-   const Tile_Propagate current_prop = (prop) ? prop->prop : TILE_PROPAGATE_FULL;
-   const int x = (prop) ? prop->x : px;
-   const int y = (prop) ? prop->y : py;
    unsigned int k;
    uint8_t imposed;
-   Eina_Rectangle zone;
 
    memset(next, 0, sizeof(next));
 
@@ -1389,17 +1734,454 @@ bitmap_tile_calculate(Editor           *ed,
                                    next[k].tl, next[k].tr,
                                    next[k].bl, next[k].br,
                                    TILE_RANDOMIZE, EINA_FALSE);
+             _propagation_changed(metrics, next[k].x, next[k].y);
 
              if (next[k].conflict == EINA_FALSE)
                continue;
 
-             ok &= bitmap_tile_calculate(ed, x, y, &(next[k]));
+             _propagation_push(ed, next[k].x, next[k].y, next[k].prop);
           }
      }
 
-   EINA_RECTANGLE_SET(&zone, x - 1, y - 1, 3, 3);
-   bitmap_refresh(ed, &zone);
+   return ok;
+}
+
+/*
+ * Drains the worklist. The cells to propagate from must have been
+ * pushed already.
+ */
+static Eina_Bool
+_propagation_run(Editor             *ed,
+                 Bitmap_Propagation *m)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const unsigned int size = map_w * ed->pud->map_h;
+   Eina_Bool ok = EINA_TRUE;
+   unsigned int cell;
+   Tile_Propagate prop;
+
+   /*
+    * Breadth-first: cells are solved in the order their conflicts were
+    * found. A cell is queued at most once at a time, so the worklist
+    * never holds more cells than the map.
+    */
+   while (ed->bitmap.propagation.count > 0)
+     {
+        if (ed->bitmap.propagation.count > m->frontier_max)
+          m->frontier_max = ed->bitmap.propagation.count;
+
+        cell = ed->bitmap.propagation.fifo[ed->bitmap.propagation.head];
+        ed->bitmap.propagation.head = (ed->bitmap.propagation.head + 1) % size;
+        ed->bitmap.propagation.count--;
+        prop = ed->bitmap.propagation.pending[cell];
+        ed->bitmap.propagation.pending[cell] = 0;
+
+        /* Conflicts resolution always converges. If it does not, give up
+         * instead of looping forever. */
+        if (EINA_UNLIKELY(++m->visited > size * BITMAP_PROPAGATION_VISITS_MAX))
+          {
+             ERR("Tile propagation does not converge");
+             while (ed->bitmap.propagation.count > 0)
+               {
+                  cell = ed->bitmap.propagation.fifo[ed->bitmap.propagation.head];
+                  ed->bitmap.propagation.pending[cell] = 0;
+                  ed->bitmap.propagation.head = (ed->bitmap.propagation.head + 1) % size;
+                  ed->bitmap.propagation.count--;
+               }
+             ok = EINA_FALSE;
+             break;
+          }
+
+        ok &= _propagation_solve(ed, cell % map_w, cell / map_w, prop, m);
+     }
+   ed->bitmap.propagation.head = 0;
+
+   /* Commit: only the cells that were actually set are drawn again */
+   bitmap_refresh_schedule(ed, &(m->changed));
+   stats_add(STATS_PROPAGATED_CELLS, m->visited);
+
+   return ok;
+}
+
+Eina_Bool
+bitmap_tile_calculate(Editor             *ed,
+                      int                 x,
+                      int                 y,
+                      Bitmap_Propagation *metrics)
+{
+   Bitmap_Propagation m;
+   Eina_Bool ok;
+
+   if (EINA_UNLIKELY(!ed->bitmap.propagation.fifo))
+     return EINA_FALSE;
+   if (((unsigned int)x >= ed->pud->map_w) ||
+       ((unsigned int)y >= ed->pud->map_h))
+     return EINA_FALSE;
+
+   memset(&m, 0, sizeof(m));
+   _propagation_changed(&m, x, y);
+   _propagation_push(ed, x, y, TILE_PROPAGATE_FULL);
+   ok = _propagation_run(ed, &m);
+
+   if (metrics) *metrics = m;
+   return ok;
+}
+
+static inline Eina_Bool
+_region_has(const Eina_Rectangle *bounds,
+            const uint8_t        *mask,
+            int                   x,
+            int                   y)
+{
+   if (!eina_rectangle_xcoord_inside(bounds, x) ||
+       !eina_rectangle_ycoord_inside(bounds, y))
+     return EINA_FALSE;
+   return (!mask) || mask[(y - bounds->y) * bounds->w + (x - bounds->x)];
+}
+
+/*
+ * Directions in which a cell of the region has neighbours out of the
+ * region (and within the map). 0 for inner cells.
+ */
+static Tile_Propagate
+_region_border_get(const Editor         *ed,
+                   const Eina_Rectangle *bounds,
+                   const uint8_t        *mask,
+                   int                   x,
+                   int                   y)
+{
+   Tile_Propagate prop = TILE_PROPAGATE_NONE;
+   const int map_w = ed->pud->map_w;
+   const int map_h = ed->pud->map_h;
+   int i, j;
+
+   for (j = -1; j <= 1; j++)
+     for (i = -1; i <= 1; i++)
+       {
+          if ((x + i < 0) || (x + i >= map_w) ||
+              (y + j < 0) || (y + j >= map_h))
+            continue;
+          if (_region_has(bounds, mask, x + i, y + j))
+            continue;
+          if (j < 0) prop |= TILE_PROPAGATE_T;
+          if (j > 0) prop |= TILE_PROPAGATE_B;
+          if (i < 0) prop |= TILE_PROPAGATE_L;
+          if (i > 0) prop |= TILE_PROPAGATE_R;
+       }
+   return prop;
+}
+
+static void
+_region_impose(Editor               *ed,
+               const Eina_Rectangle *area,
+               const Eina_Rectangle *bounds,
+               const uint8_t        *mask,
+               uint8_t               component,
+               uint8_t               randomize)
+{
+   int x, y;
+
+   for (y = area->y; y < area->y + area->h; y++)
+     for (x = area->x; x < area->x + area->w; x++)
+       {
+          if (_region_has(bounds, mask, x, y))
+            bitmap_tile_set(ed, x, y, component, component,
+                            component, component, randomize, EINA_TRUE);
+       }
+}
+
+static Eina_Bool
+_region_propagate(Editor               *ed,
+                  const Eina_Rectangle *area,
+                  const Eina_Rectangle *bounds,
+                  const uint8_t        *mask,
+                  Bitmap_Propagation   *m)
+{
+   Tile_Propagate prop;
+   int x, y;
+
+   for (y = area->y; y < area->y + area->h; y++)
+     for (x = area->x; x < area->x + area->w; x++)
+       {
+          if (!_region_has(bounds, mask, x, y)) continue;
+          prop = _region_border_get(ed, bounds, mask, x, y);
+          if (prop != TILE_PROPAGATE_NONE)
+            _propagation_push(ed, x, y, prop);
+       }
+   return _propagation_run(ed, m);
+}
+
+Eina_Bool
+bitmap_tiles_impose(Editor               *ed,
+                    const Eina_Rectangle *bounds,
+                    const uint8_t        *mask,
+                    uint8_t               component,
+                    uint8_t               randomize,
+                    Bitmap_Propagation   *metrics)
+{
+   Bitmap_Propagation m;
+   Eina_Rectangle area;
+   Eina_Bool dark_water = EINA_FALSE, ok;
+   int x, y;
 
+   EINA_SAFETY_ON_NULL_RETURN_VAL(bounds, EINA_FALSE);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(tile_wall_is(component, component,
+                                               component, component),
+                                  EINA_FALSE);
+   if (EINA_UNLIKELY(!ed->bitmap.propagation.fifo))
+     return EINA_FALSE;
+
+   /* Only the part of the region within the map */
+   EINA_RECTANGLE_SET(&area, 0, 0, ed->pud->map_w, ed->pud->map_h);
+   if (!eina_rectangle_intersection(&area, bounds))
+     return EINA_TRUE;
+
+   for (y = area.y; (!dark_water) && (y < area.y + area.h); y++)
+     for (x = area.x; x < area.x + area.w; x++)
+       {
+          if (_region_has(bounds, mask, x, y) &&
+              TILE_DARK_WATER_IS(&(ed->cells[y][x])))
+            {
+               dark_water = EINA_TRUE;
+               break;
+            }
+       }
+
+   memset(&m, 0, sizeof(m));
+   m.changed = area;
+
+   /*
+    * All the fragments are written first. Inner cells cannot conflict
+    * with each other, so the propagation starts from the border of the
+    * region only, and each cell around it is solved once.
+    */
+   _region_impose(ed, &area, bounds, mask, component, randomize);
+   ok = _region_propagate(ed, &area, bounds, mask, &m);
+
+   /* Same as when placing a single tile: dark water around the region
+    * may have messed up its border. Imposing the tiles again fixes it. */
+   if (dark_water)
+     {
+        _region_impose(ed, &area, bounds, mask, component, randomize);
+        ok &= _region_propagate(ed, &area, bounds, mask, &m);
+     }
+
+   if (metrics) *metrics = m;
+   return ok;
+}
+
+static inline Eina_Bool
+_fill_match(const Editor  *ed,
+            const uint8_t *region,
+            uint8_t        class,
+            unsigned int   x,
+            unsigned int   y)
+{
+   const Cell *const c = &(ed->cells[y][x]);
+
+   return ((!region[(y * ed->pud->map_w) + x]) &&
+           (c->tile_tl == class) && (TILE_SOLID_IS(c)));
+}
+
+Eina_Bool
+bitmap_fill(Editor  *ed,
+            int      x,
+            int      y,
+            uint8_t  component,
+            uint8_t  randomize)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const unsigned int map_h = ed->pud->map_h;
+   const unsigned int stack_max = 2 * map_w * map_h;
+   const Cell *c;
+   uint8_t *region = NULL, *mask = NULL;
+   uint32_t *stack = NULL;
+   unsigned int n = 0, k, i, j, x1, x2, row;
+   unsigned int min_x = map_w, min_y = map_h, max_x = 0, max_y = 0;
+   Eina_Rectangle bounds;
+   Eina_Bool in_run, ok = EINA_FALSE;
+   uint8_t class;
+   int dj;
+
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(((unsigned int)x >= map_w) ||
+                                  ((unsigned int)y >= map_h),
+                                  EINA_FALSE);
+
+   /* Only solid terrains are filled, and not with themselves */
+   c = &(ed->cells[y][x]);
+   class = c->tile_tl;
+   if ((!TILE_SOLID_IS(c)) || (TILE_WALL_IS(c)) || (class == component))
+     return EINA_FALSE;
+
+   region = calloc(map_w * map_h, sizeof(uint8_t));
+   stack = malloc(stack_max * sizeof(uint32_t));
+   if (EINA_UNLIKELY((!region) || (!stack)))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+   /*
+    * Scanline fill of the 4-connected cells of the same class: each seed
+    * is extended to its whole run on the row, and the runs of the rows
+    * above and below are seeded once each.
+    */
+   stack[n++] = (y * map_w) + x;
+   while (n > 0)
+     {
+        k = stack[--n];
+        i = k % map_w;
+        j = k / map_w;
+        if (!_fill_match(ed, region, class, i, j))
+          continue;
+
+        for (x1 = i; (x1 > 0) && _fill_match(ed, region, class, x1 - 1, j); x1--);
+        for (x2 = i; (x2 < map_w - 1) && _fill_match(ed, region, class, x2 + 1, j); x2++);
+        memset(&(region[(j * map_w) + x1]), 1, x2 - x1 + 1);
+
+        min_x = MIN(min_x, x1);
+        max_x = MAX(max_x, x2);
+        min_y = MIN(min_y, j);
+        max_y = MAX(max_y, j);
+
+        for (dj = -1; dj <= 1; dj += 2)
+          {
+             if (((dj < 0) && (j == 0)) || ((dj > 0) && (j == map_h - 1)))
+               continue;
+             row = j + dj;
+             in_run = EINA_FALSE;
+             for (i = x1; i <= x2; i++)
+               {
+                  if (!_fill_match(ed, region, class, i, row))
+                    in_run = EINA_FALSE;
+                  else if (!in_run)
+                    {
+                       in_run = EINA_TRUE;
+                       if (EINA_UNLIKELY(n >= stack_max))
+                         {
+                            CRI("Fill stack overflow");
+                            goto end;
+                         }
+                       stack[n++] = (row * map_w) + i;
+                    }
+               }
+          }
+     }
+
+   /* The region, in its bounding box */
+   EINA_RECTANGLE_SET(&bounds, min_x, min_y,
+                      max_x - min_x + 1, max_y - min_y + 1);
+   mask = malloc(bounds.w * bounds.h);
+   if (EINA_UNLIKELY(!mask))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+   for (j = 0; j < (unsigned int)bounds.h; j++)
+     memcpy(&(mask[j * bounds.w]),
+            &(region[((min_y + j) * map_w) + min_x]), bounds.w);
+
+   /* One transaction, propagated from the edge of the region */
+   ok = bitmap_tiles_impose(ed, &bounds, mask, component, randomize, NULL);
+
+end:
+   free(mask);
+   free(stack);
+   free(region);
+   return ok;
+}
+
+Eina_Bool
+bitmap_wall_segment_set(Editor  *ed,
+                        int      x0,
+                        int      y0,
+                        int      x1,
+                        int      y1,
+                        uint8_t  wall)
+{
+   const unsigned int dx = abs(x1 - x0);
+   const unsigned int dy = abs(y1 - y0);
+   const unsigned int count = dx + dy + 1;
+   Evas_Point *cells = NULL;
+   uint8_t *grass = NULL;
+   Eina_Rectangle bounds, zone;
+   unsigned int k, ix = 0, iy = 0;
+   int x = x0, y = y0;
+   Eina_Bool ok = EINA_FALSE;
+
+   EINA_SAFETY_ON_FALSE_RETURN_VAL(tile_wall_is(wall, wall, wall, wall),
+                                   EINA_FALSE);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL((x0 < 0) || (y0 < 0) || (x1 < 0) || (y1 < 0) ||
+                                  (x0 >= (int)ed->pud->map_w) ||
+                                  (x1 >= (int)ed->pud->map_w) ||
+                                  (y0 >= (int)ed->pud->map_h) ||
+                                  (y1 >= (int)ed->pud->map_h),
+                                  EINA_FALSE);
+
+   EINA_RECTANGLE_SET(&bounds, MIN(x0, x1), MIN(y0, y1), dx + 1, dy + 1);
+   cells = malloc(count * sizeof(*cells));
+   grass = calloc(bounds.w * bounds.h, sizeof(uint8_t));
+   if (EINA_UNLIKELY(!cells || !grass))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+   /*
+    * Cells of the segment. Walls only join by their sides, so the line
+    * is 4-connected: each step goes either horizontally or vertically,
+    * whichever stays closest to the ideal line.
+    */
+   for (k = 0; k < count; ++k)
+     {
+        cells[k].x = x;
+        cells[k].y = y;
+        /* Walls are laid on grass, that does not replace existing walls */
+        if (!TILE_WALL_IS(&(ed->cells[y][x])))
+          grass[(y - bounds.y) * bounds.w + (x - bounds.x)] = 1;
+
+        if ((1 + 2 * ix) * dy < (1 + 2 * iy) * dx)
+          {
+             x += (x1 > x0) ? 1 : -1;
+             ix++;
+          }
+        else
+          {
+             y += (y1 > y0) ? 1 : -1;
+             iy++;
+          }
+     }
+
+   /* One propagation for the grass under the whole segment */
+   bitmap_tiles_impose(ed, &bounds, grass, TILE_GRASS_LIGHT,
+                       TILE_RANDOMIZE, NULL);
+
+   wall = _wall_close(wall);
+   for (k = 0; k < count; ++k)
+     bitmap_tile_set(ed, cells[k].x, cells[k].y,
+                     wall, wall, wall, wall, 0, EINA_TRUE);
+
+   /*
+    * Sides are solved once all walls are there: the segment, and the
+    * walls it now touches.
+    */
+   for (k = 0; k < count; ++k)
+     {
+        _wall_sides_update(ed, cells[k].x, cells[k].y);
+        _wall_sides_update(ed, cells[k].x - 1, cells[k].y);
+        _wall_sides_update(ed, cells[k].x + 1, cells[k].y);
+        _wall_sides_update(ed, cells[k].x, cells[k].y - 1);
+        _wall_sides_update(ed, cells[k].x, cells[k].y + 1);
+     }
+
+   EINA_RECTANGLE_SET(&zone, bounds.x - 1, bounds.y - 1,
+                      bounds.w + 2, bounds.h + 2);
+   bitmap_refresh_schedule(ed, &zone);
+   ok = EINA_TRUE;
+
+end:
+   free(cells);
+   free(grass);
    return ok;
 }
 
@@ -1417,31 +2199,15 @@ _bitmap_full_tile_set(Editor   *ed,
 
    Cell *c = &(ed->cells[y][x]);
 
-   if ((c->unit_below != PUD_UNIT_NONE) && force)
+   snapshot_cell_touch(ed, x, y);
+   if (force && !cell_unit_below_fits_is(c))
      {
-        /*
-         * Big fat-*ss condition!
-         * When NOT to delete a unit:
-         *  - unit is marine and tile is water
-         *  - unit is flying
-         *  - unit is land and
-         *    - if unit is a building and tile is constructible
-         *    - else (unit is not a building) if tile is walkable
-         */
-        if (!((TILE_WATER_IS(c) && pud_unit_marine_is(c->unit_below)) ||
-              (pud_unit_flying_is(c->unit_below)) ||
-              (pud_unit_land_is(c->unit_below) &&
-               ((!pud_unit_building_is(c->unit_below) &&
-                 TILE_WALKABLE_IS(c)) ||
-                (pud_unit_building_is(c->unit_below) &&
-                 TILE_GRASS_IS(c))))))
-          {
-             bitmap_unit_del_at(ed, x, y, UNIT_BELOW);
-             bitmap_refresh(ed, NULL); // XXX
-          }
+        bitmap_unit_del_at(ed, x, y, UNIT_BELOW);
+        bitmap_refresh_schedule(ed, NULL); // XXX
      }
 
    c->tile = tile;
+   editor_maps_dirty_set(ed, x, y);
    minimap_update(ed, x, y);
 
    return EINA_TRUE;
@@ -1471,6 +2237,7 @@ bitmap_tile_set(Editor    *ed,
      do_wall = EINA_TRUE;
 
    /* Set tile internals */
+   snapshot_cell_touch(ed, x, y);
    c->tile_tl = tl;
    c->tile_tr = tr;
    c->tile_bl = bl;
@@ -1483,7 +2250,7 @@ bitmap_tile_set(Editor    *ed,
 
    tile = tile_calculate(c->tile_tl, c->tile_tr,
                          c->tile_bl, c->tile_br,
-                         seed, ed->pud->era);
+                         seed, ed->pud->era, &(ed->prng));
 
    if (!force && same)
      {
@@ -1502,10 +2269,12 @@ bitmap_tile_set(Editor    *ed,
 Eina_Bool
 bitmap_add(Editor *ed)
 {
+   Evas *e;
+   Evas_Object *o;
+
    EINA_SAFETY_ON_NULL_RETURN_VAL(ed, EINA_FALSE);
 
-   Evas *const e = evas_object_evas_get(ed->win);
-   Evas_Object *o;
+   e = evas_object_evas_get(ed->win);
 
    /* The scroller*/
    evas_object_event_callback_add(ed->scroller, EVAS_CALLBACK_RESIZE,
@@ -1514,16 +2283,16 @@ bitmap_add(Editor *ed)
    /* Set dimensions */
    ed->bitmap.x_off = 0;
    ed->bitmap.y_off = 0;
-   ed->bitmap.cell_w = 32;
-   ed->bitmap.cell_h = 32;
+   ed->bitmap.zoom = 0;
+   ed->bitmap.cell_w = TEXTURE_WIDTH;
+   ed->bitmap.cell_h = TEXTURE_HEIGHT;
    ed->bitmap.cx = -1;
    ed->bitmap.cy = -1;
    ed->bitmap.max_w = ed->bitmap.cell_w * ed->pud->map_w;
    ed->bitmap.max_h = ed->bitmap.cell_h * ed->pud->map_h;
 
-   /* Bitmap image */
-   o = ed->bitmap.img = evas_object_image_filled_add(e);
-   evas_object_image_colorspace_set(o, EVAS_COLORSPACE_ARGB8888);
+   /* Bitmap grid: holds the chunks images */
+   o = ed->bitmap.grid = elm_grid_add(ed->scroller);
    evas_object_size_hint_align_set(o, 0.0, 0.0);
    evas_object_size_hint_weight_set(o, 0.0, 0.0);
    elm_object_content_set(ed->scroller, o);
@@ -1534,16 +2303,13 @@ bitmap_add(Editor *ed)
    evas_object_pass_events_set(o, EINA_FALSE);
    evas_object_show(o);
 
-   bitmap_resize(ed);
+   /* Receives the mouse events where chunks are not loaded */
+   o = ed->bitmap.events = evas_object_rectangle_add(e);
+   evas_object_color_set(o, 0, 0, 0, 0);
+   elm_grid_pack(ed->bitmap.grid, o, 0, 0, 1, 1);
+   evas_object_show(o);
 
-   /* Debug will required text */
-   if (ed->debug != EDITOR_DEBUG_NONE)
-     {
-        cairo_select_font_face(ed->bitmap.cr, "Sans",
-                               CAIRO_FONT_SLANT_NORMAL,
-                               CAIRO_FONT_WEIGHT_NORMAL);
-        cairo_set_font_size(ed->bitmap.cr, 8);
-     }
+   bitmap_resize(ed);
 
    /* Clip - to avoid the cursor overlapping with the scroller */
    o = ed->bitmap.clip = evas_object_rectangle_add(e);
@@ -1569,7 +2335,6 @@ bitmap_add(Editor *ed)
 void
 bitmap_resize(Editor *ed)
 {
-   unsigned char *pixels;
    Eina_Bool recount = EINA_FALSE;
 
    INF("Resizing bitmap: %i,%i", ed->pud->map_w, ed->pud->map_h);
@@ -1577,25 +2342,47 @@ bitmap_resize(Editor *ed)
    ed->bitmap.max_w = ed->bitmap.cell_w * ed->pud->map_w;
    ed->bitmap.max_h = ed->bitmap.cell_h * ed->pud->map_h;
 
-   evas_object_size_hint_min_set(ed->bitmap.img, ed->bitmap.max_w, ed->bitmap.max_h);
-   evas_object_size_hint_max_set(ed->bitmap.img, ed->bitmap.max_w, ed->bitmap.max_h);
+   evas_object_size_hint_min_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   evas_object_size_hint_max_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   elm_grid_size_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   elm_grid_pack_set(ed->bitmap.events, 0, 0, ed->bitmap.max_w, ed->bitmap.max_h);
 
-   /* Cairo surface for the game */
-   if (ed->bitmap.surf)
+   /* Terrain cache. It is released before the chunks, which are evicted
+    * with the new dimensions of the map */
+   free(ed->bitmap.terrain.tiles);
+   ed->bitmap.terrain.tiles = NULL;
+   if (EINA_UNLIKELY(!chunks_resize(ed)))
+     {
+        CRI("Failed to create bitmap chunks");
+        return;
+     }
+   ed->bitmap.terrain.tiles = malloc(ed->pud->map_w * ed->pud->map_h *
+                                     sizeof(uint16_t));
+   if (EINA_UNLIKELY(!ed->bitmap.terrain.tiles))
      {
-        cairo_destroy(ed->bitmap.cr);
-        cairo_surface_destroy(ed->bitmap.surf);
+        CRI("Failed to allocate memory");
+        return;
+     }
+   bitmap_terrain_invalidate(ed, NULL);
+
+   /* Tile propagation worklist */
+   free(ed->bitmap.propagation.fifo);
+   free(ed->bitmap.propagation.pending);
+   ed->bitmap.propagation.fifo = malloc(ed->pud->map_w * ed->pud->map_h *
+                                        sizeof(uint32_t));
+   ed->bitmap.propagation.pending = calloc(ed->pud->map_w * ed->pud->map_h,
+                                           sizeof(uint8_t));
+   ed->bitmap.propagation.head = 0;
+   ed->bitmap.propagation.count = 0;
+   if (EINA_UNLIKELY((!ed->bitmap.propagation.fifo) ||
+                     (!ed->bitmap.propagation.pending)))
+     {
+        CRI("Failed to allocate memory");
+        free(ed->bitmap.propagation.fifo);
+        free(ed->bitmap.propagation.pending);
+        ed->bitmap.propagation.fifo = NULL;
+        ed->bitmap.propagation.pending = NULL;
      }
-   ed->bitmap.surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-                                                ed->bitmap.max_w,
-                                                ed->bitmap.max_h);
-   ed->bitmap.cr = cairo_create(ed->bitmap.surf);
-   cairo_surface_flush(ed->bitmap.surf);
-   pixels = cairo_image_surface_get_data(ed->bitmap.surf);
-   evas_object_image_size_set(ed->bitmap.img,
-                              cairo_image_surface_get_width(ed->bitmap.surf),
-                              cairo_image_surface_get_height(ed->bitmap.surf));
-   evas_object_image_data_set(ed->bitmap.img, pixels);
 
    if (ed->cells)
      {
@@ -1607,6 +2394,14 @@ bitmap_resize(Editor *ed)
      {
         CRI("Failed to create cells matrix");
      }
+   if (EINA_UNLIKELY(!unitindex_reset(ed)))
+     {
+        CRI("Failed to create units index");
+     }
+   if (EINA_UNLIKELY(!editor_maps_reset(ed)))
+     {
+        CRI("Failed to create the maps dirty cells");
+     }
    if (recount)
      {
         editor_units_recount(ed);
@@ -1622,12 +2417,23 @@ void
 bitmap_del(Editor *ed)
 {
    evas_object_event_callback_del_full(ed->scroller, EVAS_CALLBACK_RESIZE, _bitmap_resize_cb, ed);
-   evas_object_event_callback_del_full(ed->bitmap.img, EVAS_CALLBACK_MOUSE_DOWN, _mouse_down_cb, ed);
-   evas_object_event_callback_del_full(ed->bitmap.img, EVAS_CALLBACK_MOUSE_MOVE, _mouse_move_cb, ed);
-   evas_object_event_callback_del_full(ed->bitmap.img, EVAS_CALLBACK_MOUSE_UP, _mouse_up_cb, ed);
-   cairo_destroy(ed->bitmap.cr);
-   cairo_surface_destroy(ed->bitmap.surf);
-   evas_object_del(ed->bitmap.img);
+   evas_object_event_callback_del_full(ed->bitmap.grid, EVAS_CALLBACK_MOUSE_DOWN, _mouse_down_cb, ed);
+   evas_object_event_callback_del_full(ed->bitmap.grid, EVAS_CALLBACK_MOUSE_MOVE, _mouse_move_cb, ed);
+   evas_object_event_callback_del_full(ed->bitmap.grid, EVAS_CALLBACK_MOUSE_UP, _mouse_up_cb, ed);
+   _bitmap_refresh_cancel(ed);
+   free(ed->bitmap.terrain.tiles);
+   ed->bitmap.terrain.tiles = NULL;
+   free(ed->bitmap.propagation.fifo);
+   free(ed->bitmap.propagation.pending);
+   ed->bitmap.propagation.fifo = NULL;
+   ed->bitmap.propagation.pending = NULL;
+   chunks_free(ed);
+   evas_object_del(ed->bitmap.grid);
+   if (ed->hud.text)
+     {
+        evas_object_del(ed->hud.text);
+        ed->hud.text = NULL;
+     }
 }
 
 void
@@ -1639,6 +2445,67 @@ bitmap_cell_size_get(const Editor *ed,
    if (h) *h = ed->bitmap.cell_h;
 }
 
+void
+bitmap_zoom_set(Editor       *ed,
+                unsigned int  zoom)
+{
+   int rx, ry, rw, rh, cx, cy, cw, ch;
+
+   if (zoom >= ATLAS_MIP_LEVELS) zoom = ATLAS_MIP_LEVELS - 1;
+   if (zoom == ed->bitmap.zoom) return;
+
+   /* The cell at the center of the view will remain there */
+   elm_scroller_region_get(ed->scroller, &rx, &ry, &rw, &rh);
+   cx = (rx + rw / 2) / ed->bitmap.cell_w;
+   cy = (ry + rh / 2) / ed->bitmap.cell_h;
+
+   /* Chunks are released with the cells size they were created with */
+   chunks_free(ed);
+
+   ed->bitmap.zoom = zoom;
+   ed->bitmap.cell_w = TEXTURE_WIDTH >> zoom;
+   ed->bitmap.cell_h = TEXTURE_HEIGHT >> zoom;
+   ed->bitmap.max_w = ed->bitmap.cell_w * ed->pud->map_w;
+   ed->bitmap.max_h = ed->bitmap.cell_h * ed->pud->map_h;
+   INF("Zoom level %u: cells are %ix%i pixels",
+       zoom, ed->bitmap.cell_w, ed->bitmap.cell_h);
+
+   evas_object_size_hint_min_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   evas_object_size_hint_max_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   elm_grid_size_set(ed->bitmap.grid, ed->bitmap.max_w, ed->bitmap.max_h);
+   elm_grid_pack_set(ed->bitmap.events, 0, 0, ed->bitmap.max_w, ed->bitmap.max_h);
+
+   if (EINA_UNLIKELY(!chunks_resize(ed)))
+     {
+        CRI("Failed to create bitmap chunks");
+        return;
+     }
+   bitmap_terrain_invalidate(ed, NULL);
+
+   /* The cursor is expressed in pixels: it must be sent again */
+   cw = ed->bitmap.cw;
+   ch = ed->bitmap.ch;
+   ed->bitmap.cw = -1;
+   bitmap_cursor_size_set(ed, cw, ch);
+   cx -= rw / (2 * ed->bitmap.cell_w);
+   cy -= rh / (2 * ed->bitmap.cell_h);
+   elm_scroller_region_show(ed->scroller,
+                            cx * ed->bitmap.cell_w, cy * ed->bitmap.cell_h,
+                            rw, rh);
+   cw = ed->bitmap.cx;
+   ch = ed->bitmap.cy;
+   ed->bitmap.cx = -1;
+   bitmap_cursor_move(ed, cw, ch);
+
+   _bitmap_autoresize(ed);
+}
+
+unsigned int
+bitmap_zoom_get(const Editor *ed)
+{
+   return ed->bitmap.zoom;
+}
+
 void
 bitmap_cursor_size_set(Editor *ed,
                        int     cw,
@@ -1761,16 +2628,113 @@ bitmap_cells_to_coords(const Editor *ed,
    if (y) *y = (ed->bitmap.cell_h * cy) - ed->bitmap.y_off;
 }
 
+static void
+_bitmap_unit_draw_cb(void         *data,
+                     unsigned int  x,
+                     unsigned int  y,
+                     Unit          type)
+{
+   bitmap_unit_draw(data, x, y, type);
+}
+
+static void
+_bitmap_chunk_draw(Editor               *ed,
+                   Chunk                *chunk,
+                   const Eina_Rectangle *zone)
+{
+   cairo_t *const cr = chunk->cr;
+   cairo_t *const prev_cr = ed->bitmap.cr;
+   const Eina_Rectangle area = *zone;
+   const int x2 = area.x + area.w;
+   const int y2 = area.y + area.h;
+   const int cw = ed->bitmap.cell_w;
+   const int ch = ed->bitmap.cell_h;
+   int ox1, oy1, ox2, oy2;
+   int i, j;
+
+   /*
+    * Drawing functions render in the current chunk. The previous context
+    * is restored afterwards, as chunks may be drawn from within a draw
+    * (e.g. when a chunk is loaded).
+    */
+   ed->bitmap.cr = cr;
+
+   /* Update the terrain layer. Only modified tiles are drawn. */
+   for (j = area.y; j < y2; ++j)
+     for (i = area.x; i < x2; ++i)
+       bitmap_tile_draw(ed, i, j);
+
+   /*
+    * Compose the refreshed zone: terrain is copied as is, then overlays
+    * (units and selections) are drawn over it. Everything is clipped to
+    * the zone, so overlays overflowing it are not blended twice.
+    */
+   blit_surface(chunk->surf,
+                (area.x * cw) - chunk->geo.x, (area.y * ch) - chunk->geo.y,
+                chunk->terrain,
+                (area.x * cw) - chunk->geo.x, (area.y * ch) - chunk->geo.y,
+                (x2 - area.x) * cw, (y2 - area.y) * ch);
+   cairo_save(cr);
+   cairo_rectangle(cr, area.x * cw, area.y * ch,
+                   (x2 - area.x) * cw, (y2 - area.y) * ch);
+   cairo_clip(cr);
+
+   /* Units whose sprite intersects the zone, back to front */
+   unitindex_foreach(ed, &area, _bitmap_unit_draw_cb, ed);
+
+   /*
+    * Selections are drawn from the anchor of their unit (top-left cell),
+    * so anchors are looked for around the zone.
+    */
+   ox1 = area.x - (BITMAP_UNIT_SPREAD_MAX + BITMAP_UNIT_OVERFLOW);
+   oy1 = area.y - (BITMAP_UNIT_SPREAD_MAX + BITMAP_UNIT_OVERFLOW);
+   ox2 = x2 + BITMAP_UNIT_OVERFLOW;
+   oy2 = y2 + BITMAP_UNIT_OVERFLOW;
+   if (ox1 < 0) ox1 = 0;
+   if (oy1 < 0) oy1 = 0;
+   if ((unsigned int)ox2 > ed->pud->map_w) ox2 = ed->pud->map_w;
+   if ((unsigned int)oy2 > ed->pud->map_h) oy2 = ed->pud->map_h;
+
+   /* Debug: print cells numbers */
+   if (ed->debug)
+     {
+        cairo_set_line_width(cr, 2);
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        for (j = y2 - 1; j >= area.y; --j)
+          {
+             cairo_move_to(cr, area.x * cw, j * ch);
+             cairo_line_to(cr, x2 * cw, j * ch);
+             cairo_stroke(cr);
+          }
+        for (i = x2 - 1; i >= area.x; --i)
+          {
+             cairo_move_to(cr, i * cw, area.y * ch);
+             cairo_line_to(cr, i * cw, y2 * ch);
+             cairo_stroke(cr);
+          }
+
+        for (j = y2 - 1; j >= area.y; --j)
+          for (i = x2 - 1; i >= area.x; --i)
+            bitmap_debug_cell(ed, i, j);
+     }
+
+   /* (Pre)Selections last */
+   bitmap_selections_draw(ed, ox1, oy1, ox2 - ox1, oy2 - oy1);
+   cairo_restore(cr);
+   ed->bitmap.cr = prev_cr;
+}
+
 void
 bitmap_refresh(Editor               *ed,
                const Eina_Rectangle *zone)
 {
-   Eina_Rectangle area;
-   Eina_Rectangle img/*, update*/;
+   Eina_Rectangle area, cells;
+   Chunk *chunk;
    int x2, y2;
-   int i, j;
+   double start;
 
    if (ed->bitmap.norender) return;
+   start = ecore_time_get();
 
    bitmap_visible_zone_cells_get(ed, &area);
    //DBG("Visible zone %"EINA_RECTANGLE_FORMAT, EINA_RECTANGLE_ARGS(&area));
@@ -1798,82 +2762,82 @@ bitmap_refresh(Editor               *ed,
      x2 = ed->pud->map_w;
    if ((unsigned int)y2 > ed->pud->map_h)
      y2 = ed->pud->map_h;
+   area.w = x2 - area.x;
+   area.h = y2 - area.y;
 
-   /*
-    * XXX Not great... Simple, Stupid yet
-    */
+   /* The atlas has changed: all tiles must be drawn again */
+   if (ed->bitmap.terrain.era != ed->pud->era)
+     bitmap_terrain_invalidate(ed, NULL);
 
-   /* Tiles first (plus start locations) */
-   for (j = area.y; j < y2; ++j)
-     for (i = area.x; i < x2; ++i)
-       {
-          bitmap_tile_draw(ed, i, j);
-          bitmap_unit_draw(ed, i, j, UNIT_START_LOCATION);
-       }
-
-   /* Units below */
-   for (j = y2 - 1; j >= area.y; --j)
-     for (i = x2 - 1; i >= area.x; --i)
-       bitmap_unit_draw(ed, i, j, UNIT_BELOW);
+   /* Tiles of large areas first, then each chunk composes its part */
+   _bitmap_terrain_render(ed, &area);
 
-   /* Units above */
-   for (j = y2 - 1; j >= area.y; --j)
-     for (i = x2 - 1; i >= area.x; --i)
-       bitmap_unit_draw(ed, i, j, UNIT_ABOVE);
-
-   /* Debug: print cells numbers */
-   if (ed->debug)
+   /* Only resident chunks are drawn. The others will be when loaded. */
+   EINA_INLIST_FOREACH(ed->bitmap.chunks.lru, chunk)
      {
-        cairo_t *const cr = ed->bitmap.cr;
-        cairo_set_line_width(cr, 2);
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        for (j = y2 - 1; j >= area.y; --j)
-          {
-             cairo_move_to(cr, area.x * TEXTURE_WIDTH, j * TEXTURE_HEIGHT);
-             cairo_line_to(cr, x2 * TEXTURE_WIDTH, j * TEXTURE_HEIGHT);
-             cairo_stroke(cr);
-          }
-        for (i = x2 - 1; i >= area.x; --i)
-          {
-             cairo_move_to(cr, i * TEXTURE_WIDTH, area.y * TEXTURE_HEIGHT);
-             cairo_line_to(cr, i * TEXTURE_WIDTH, y2 * TEXTURE_HEIGHT);
-             cairo_stroke(cr);
-          }
-
-        for (j = y2 - 1; j >= area.y; --j)
-          for (i = x2 - 1; i >= area.x; --i)
-            bitmap_debug_cell(ed, i, j);
+        EINA_RECTANGLE_SET(&cells,
+                           chunk->geo.x / ed->bitmap.cell_w,
+                           chunk->geo.y / ed->bitmap.cell_h,
+                           chunk->geo.w / ed->bitmap.cell_w,
+                           chunk->geo.h / ed->bitmap.cell_h);
+        if (eina_rectangle_intersection(&cells, &area))
+          _bitmap_chunk_draw(ed, chunk, &cells);
      }
 
-   /* (Pre)Selections last */
-   bitmap_selections_draw(ed, area.x, area.y, area.w, area.h);
-
-   /* Image rectangle (relative to the image itself) */
-   img.x = 0;
-   img.y = 0;
-   evas_object_geometry_get(ed->bitmap.img, NULL, NULL, &img.w, &img.h);
+   minimap_render(ed, area.x, area.y, area.w, area.h);
 
    /*
-    * FIXME
+    * Only the refreshed area is marked as damaged. It will be merged
+    * with the other damages of the frame and uploaded only once.
     */
+   damage_bitmap_add(ed, area.x * ed->bitmap.cell_w, area.y * ed->bitmap.cell_h,
+                     area.w * ed->bitmap.cell_w, area.h * ed->bitmap.cell_h);
 
-   //bitmap_cells_to_coords(ed, area.x, area.y, &update.x, &update.y);
-   //bitmap_cells_to_coords(ed, area.x + area.w, area.y + area.h, &update.w, &update.h);
+   stats_add(STATS_REFRESHES, 1);
+   stats_add(STATS_REFRESH_USEC, (ecore_time_get() - start) * 1000000.0);
+}
 
-   evas_object_image_data_update_add(ed->bitmap.img, 0, 0, img.w, img.h);
-#if 0
-   if (eina_rectangle_intersection(&update, &img))
+void
+bitmap_refresh_schedule(Editor               *ed,
+                        const Eina_Rectangle *zone)
+{
+   Eina_Rectangle *const acc = &(ed->bitmap.pending.zone);
+
+   if (ed->bitmap.norender) return;
+
+   if (!zone)
+     ed->bitmap.pending.full = EINA_TRUE;
+   else if (!ed->bitmap.pending.full)
      {
-        DBG("Evas update: %"EINA_RECTANGLE_FORMAT, EINA_RECTANGLE_ARGS(&update));
+        if (eina_rectangle_is_empty(acc))
+          *acc = *zone;
+        else
+          eina_rectangle_union(acc, zone);
      }
+   ed->bitmap.pending.requests++;
+
+   if (!ed->bitmap.pending.animator)
+     ed->bitmap.pending.animator = ecore_animator_add(_bitmap_refresh_frame_cb, ed);
+}
+
+void
+bitmap_refresh_flush(Editor *ed)
+{
+   const Eina_Rectangle zone = ed->bitmap.pending.zone;
+   const unsigned int requests = ed->bitmap.pending.requests;
+   const Eina_Bool full = ed->bitmap.pending.full;
+
+   _bitmap_refresh_cancel(ed);
+   if (requests == 0) return;
+
+   DBG("Drawing %u refresh requests at once", requests);
+   if (full)
+     bitmap_refresh(ed, NULL);
    else
-     {
-        WRN("Something is fishy... no intersection between the image "
-            "contour and the refresh area... "
-            "update is %"EINA_RECTANGLE_FORMAT", img is %"EINA_RECTANGLE_FORMAT,
-            EINA_RECTANGLE_ARGS(&update), EINA_RECTANGLE_ARGS(&img));
-     }
-#endif
+     bitmap_refresh(ed, &zone);
+
+   /* We are already at the beginning of the frame: upload now */
+   damage_flush(ed);
 }
 
 void
@@ -1882,7 +2846,7 @@ bitmap_visible_zone_cells_get(const Editor   *ed,
 {
    int w, h;
 
-   evas_object_geometry_get(ed->bitmap.img, NULL, NULL, &w, &h);
+   evas_object_geometry_get(ed->bitmap.grid, NULL, NULL, &w, &h);
 
    bitmap_coords_to_cells(ed, 0, 0, &(zone->x), &(zone->y));
    bitmap_coords_to_cells(ed, w, h, &(zone->w), &(zone->h));
@@ -1906,6 +2870,8 @@ bitmap_render_unlock(Editor *ed)
 void
 bitmap_render_flush(Editor *ed)
 {
+   /* Everything is drawn: pending refreshes are obsolete */
+   _bitmap_refresh_cancel(ed);
    bitmap_refresh(ed, NULL);
    minimap_reload(ed);
 }
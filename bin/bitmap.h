@@ -30,6 +30,10 @@ Unit bitmap_unit_set(Editor * ed, Pud_Unit unit, Pud_Player color, unsigned int
 void bitmap_refresh(Editor *ed,
                     const Eina_Rectangle *zone);
 
+void bitmap_refresh_schedule(Editor *ed,
+                             const Eina_Rectangle *zone);
+void bitmap_refresh_flush(Editor *ed);
+
 void
 bitmap_visible_zone_cells_get(const Editor   *ed,
                               Eina_Rectangle *zone);
@@ -41,6 +45,8 @@ bitmap_selections_draw(Editor * ed,
                        unsigned int     w,
                        unsigned int     h);
 
+void bitmap_debug_hud_update(Editor *ed);
+
 void bitmap_unit_draw(Editor * ed,
                       unsigned int x,
                       unsigned int y,
@@ -49,6 +55,10 @@ void bitmap_unit_draw(Editor * ed,
 void bitmap_tile_draw(Editor * ed,
                       unsigned int x,
                       unsigned int y);
+
+void
+bitmap_terrain_invalidate(Editor               *ed,
+                          const Eina_Rectangle *zone);
 void
 bitmap_unit_del_at(Editor * ed,
                    unsigned int     x,
@@ -85,17 +95,68 @@ bitmap_cells_to_coords(const Editor *ed,
                        int          *x,
                        int          *y);
 
+typedef struct
+{
+   Eina_Rectangle changed;      /* Cells whose tile was set */
+   unsigned int   visited;      /* Cells whose neighbours were solved */
+   unsigned int   frontier_max; /* Biggest size of the worklist */
+} Bitmap_Propagation;
+
+Eina_Bool
+bitmap_tile_calculate(Editor             *ed,
+                      int                 x,
+                      int                 y,
+                      Bitmap_Propagation *metrics);
+
+/*
+ * Imposes a solid component on a region of cells (bounds, and an optional
+ * mask of bounds->w * bounds->h bytes, cells being in the region when
+ * non-zero), then propagates once from the border of the region.
+ * Walls cannot be imposed this way.
+ */
+Eina_Bool
+bitmap_tiles_impose(Editor               *ed,
+                    const Eina_Rectangle *bounds,
+                    const uint8_t        *mask,
+                    uint8_t               component,
+                    uint8_t               randomize,
+                    Bitmap_Propagation   *metrics);
+
+/*
+ * Fills the 4-connected region of solid cells of the same terrain as
+ * (x, y) with a solid component.
+ */
+Eina_Bool
+bitmap_fill(Editor  *ed,
+            int      x,
+            int      y,
+            uint8_t  component,
+            uint8_t  randomize);
+
+/*
+ * Lays a wall segment from (x0, y0) to (x1, y1), on light grass, and
+ * solves the open and closed sides of the walls at once.
+ */
 Eina_Bool
-bitmap_tile_calculate(Editor           *ed,
-                      int               px,
-                      int               py,
-                      Tile_Propagation *prop);
+bitmap_wall_segment_set(Editor  *ed,
+                        int      x0,
+                        int      y0,
+                        int      x1,
+                        int      y1,
+                        uint8_t  wall);
 
 void
 bitmap_cell_size_get(const Editor *ed,
                      int          *w,
                      int          *h);
 
+void
+bitmap_zoom_set(Editor       *ed,
+                unsigned int  zoom);
+
+unsigned int
+bitmap_zoom_get(const Editor *ed);
+
 void
 bitmap_cursor_size_set(Editor *ed,
                        int     cw,
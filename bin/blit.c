@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+# define BLIT_X86 1
+# include <immintrin.h>
+#endif
+
+typedef void (*Blit_Row_Func)(uint32_t *restrict dst, const uint32_t *restrict src, unsigned int count);
+
+typedef struct
+{
+   const char    *name;
+   Blit_Row_Func  func;
+} Blit_Impl;
+
+static const Blit_Impl *_impl = NULL;
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static void
+_blit_row_scalar(uint32_t *restrict       dst,
+                 const uint32_t *restrict src,
+                 unsigned int             count)
+{
+   memcpy(dst, src, count * sizeof(uint32_t));
+}
+
+#ifdef BLIT_X86
+__attribute__((target("sse2")))
+static void
+_blit_row_sse2(uint32_t *restrict       dst,
+               const uint32_t *restrict src,
+               unsigned int             count)
+{
+   __m128i a, b;
+
+   /* 8 pixels per iteration: a texture row is 4 iterations */
+   for (; count >= 8; count -= 8, src += 8, dst += 8)
+     {
+        a = _mm_loadu_si128((const __m128i *)(src + 0));
+        b = _mm_loadu_si128((const __m128i *)(src + 4));
+        _mm_storeu_si128((__m128i *)(dst + 0), a);
+        _mm_storeu_si128((__m128i *)(dst + 4), b);
+     }
+   for (; count >= 4; count -= 4, src += 4, dst += 4)
+     {
+        a = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dst, a);
+     }
+   for (; count > 0; --count)
+     *(dst++) = *(src++);
+}
+
+__attribute__((target("avx2")))
+static void
+_blit_row_avx2(uint32_t *restrict       dst,
+               const uint32_t *restrict src,
+               unsigned int             count)
+{
+   __m256i a, b;
+
+   /* 16 pixels per iteration: a texture row is 2 iterations */
+   for (; count >= 16; count -= 16, src += 16, dst += 16)
+     {
+        a = _mm256_loadu_si256((const __m256i *)(src + 0));
+        b = _mm256_loadu_si256((const __m256i *)(src + 8));
+        _mm256_storeu_si256((__m256i *)(dst + 0), a);
+        _mm256_storeu_si256((__m256i *)(dst + 8), b);
+     }
+   for (; count >= 8; count -= 8, src += 8, dst += 8)
+     {
+        a = _mm256_loadu_si256((const __m256i *)src);
+        _mm256_storeu_si256((__m256i *)dst, a);
+     }
+   for (; count > 0; --count)
+     *(dst++) = *(src++);
+}
+#endif
+
+static const Blit_Impl _impls[] =
+{
+#ifdef BLIT_X86
+   { "avx2", _blit_row_avx2 },
+   { "sse2", _blit_row_sse2 },
+#endif
+   { "scalar", _blit_row_scalar },
+};
+
+static Eina_Bool
+_blit_impl_supported_is(const Blit_Impl *impl)
+{
+#ifdef BLIT_X86
+   if (impl->func == _blit_row_avx2)
+     return !!__builtin_cpu_supports("avx2");
+   if (impl->func == _blit_row_sse2)
+     return !!__builtin_cpu_supports("sse2");
+#endif
+   return (impl->func == _blit_row_scalar);
+}
+
+static void
+_blit_rect_with(Blit_Row_Func        func,
+                unsigned char       *dst,
+                int                  dst_stride,
+                const unsigned char *src,
+                int                  src_stride,
+                unsigned int         w,
+                unsigned int         h)
+{
+   unsigned int j;
+
+   for (j = 0; j < h; ++j, dst += dst_stride, src += src_stride)
+     func((uint32_t *)dst, (const uint32_t *)src, w);
+}
+
+
+/*============================================================================*
+ *                                Init/Shutdown                               *
+ *============================================================================*/
+
+Eina_Bool
+blit_init(void)
+{
+   const char *env;
+   unsigned int i;
+
+#ifdef BLIT_X86
+   __builtin_cpu_init();
+#endif
+
+   /* Allows to force an implementation (e.g. for comparisons) */
+   env = getenv("WAR2EDIT_BLIT");
+
+   for (i = 0; i < EINA_C_ARRAY_LENGTH(_impls); ++i)
+     {
+        if (!_blit_impl_supported_is(&(_impls[i])))
+          continue;
+        if (env && strcmp(env, _impls[i].name))
+          continue;
+        _impl = &(_impls[i]);
+        break;
+     }
+
+   if (!_impl)
+     {
+        WRN("Blitter \"%s\" is not available. Using default.", env);
+        _impl = &(_impls[EINA_C_ARRAY_LENGTH(_impls) - 1]);
+     }
+
+   INF("Using %s blitter", _impl->name);
+   return EINA_TRUE;
+}
+
+void
+blit_shutdown(void)
+{
+   _impl = NULL;
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+void
+blit_rect(unsigned char       *dst,
+          int                  dst_stride,
+          const unsigned char *src,
+          int                  src_stride,
+          unsigned int         w,
+          unsigned int         h)
+{
+   _blit_rect_with(_impl->func, dst, dst_stride, src, src_stride, w, h);
+}
+
+void
+blit_surface(cairo_surface_t *dst,
+             int              dx,
+             int              dy,
+             cairo_surface_t *src,
+             int              sx,
+             int              sy,
+             unsigned int     w,
+             unsigned int     h)
+{
+   const int dst_stride = cairo_image_surface_get_stride(dst);
+   const int src_stride = cairo_image_surface_get_stride(src);
+   unsigned char *d;
+   const unsigned char *s;
+
+   /* Make sure cairo has not pending operations on the surfaces */
+   cairo_surface_flush(dst);
+   cairo_surface_flush(src);
+
+   d = cairo_image_surface_get_data(dst) + (dy * dst_stride) + (dx * 4);
+   s = cairo_image_surface_get_data(src) + (sy * src_stride) + (sx * 4);
+   blit_rect(d, dst_stride, s, src_stride, w, h);
+
+   cairo_surface_mark_dirty_rectangle(dst, dx, dy, w, h);
+}
+
+void
+blit_downsample(unsigned char       *dst,
+                int                  dst_stride,
+                const unsigned char *src,
+                int                  src_stride,
+                unsigned int         src_w,
+                unsigned int         src_h)
+{
+   const unsigned int w = (src_w > 1) ? src_w / 2 : 1;
+   const unsigned int h = (src_h > 1) ? src_h / 2 : 1;
+   const unsigned char *r0, *r1, *p00, *p01, *p10, *p11;
+   unsigned char *d;
+   unsigned int i, j, k;
+
+   /*
+    * Box filter: each pixel is the average of a 2x2 block. Pixels are
+    * premultiplied, so channels can be averaged independently.
+    */
+   for (j = 0; j < h; ++j)
+     {
+        r0 = src + ((2 * j) * src_stride);
+        r1 = src + (MIN(2 * j + 1, src_h - 1) * src_stride);
+        d = dst + (j * dst_stride);
+        for (i = 0; i < w; ++i, d += 4)
+          {
+             p00 = r0 + ((2 * i) * 4);
+             p01 = r0 + (MIN(2 * i + 1, src_w - 1) * 4);
+             p10 = r1 + ((2 * i) * 4);
+             p11 = r1 + (MIN(2 * i + 1, src_w - 1) * 4);
+             for (k = 0; k < 4; ++k)
+               d[k] = (p00[k] + p01[k] + p10[k] + p11[k] + 2) >> 2;
+          }
+     }
+}
+
+cairo_surface_t *
+blit_surface_downsample(cairo_surface_t *src)
+{
+   cairo_surface_t *dst;
+   const int w = cairo_image_surface_get_width(src);
+   const int h = cairo_image_surface_get_height(src);
+
+   dst = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                    (w > 1) ? w / 2 : 1, (h > 1) ? h / 2 : 1);
+   if (EINA_UNLIKELY(cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS))
+     {
+        CRI("Failed to create surface");
+        cairo_surface_destroy(dst);
+        return NULL;
+     }
+
+   cairo_surface_flush(src);
+   cairo_surface_flush(dst);
+   blit_downsample(cairo_image_surface_get_data(dst),
+                   cairo_image_surface_get_stride(dst),
+                   cairo_image_surface_get_data(src),
+                   cairo_image_surface_get_stride(src),
+                   w, h);
+   cairo_surface_mark_dirty(dst);
+
+   return dst;
+}
+
+const char *
+blit_impl_name_get(void)
+{
+   return _impl->name;
+}
+
+Eina_Bool
+blit_benchmark(void)
+{
+   const unsigned int cells = 128; /* Biggest map: 128x128 */
+   const unsigned int size = cells * TEXTURE_WIDTH;
+   unsigned int tiles_x, tiles_y;
+   cairo_surface_t *atlas, *ref, *surf;
+   cairo_t *cr;
+   unsigned int i, j, k, ox, oy;
+   int stride, atlas_stride;
+   unsigned char *ref_px, *px;
+   const unsigned char *atlas_px;
+   double start, cairo_time;
+   Eina_Bool ok = EINA_TRUE;
+
+   if (EINA_UNLIKELY(!atlas_texture_open(PUD_ERA_FOREST)))
+     {
+        ERR("Failed to open forest atlas");
+        return EINA_FALSE;
+     }
+   atlas = atlas_texture_get(PUD_ERA_FOREST);
+
+   /* Tiles are taken all over the atlas, as the map would */
+   tiles_x = cairo_image_surface_get_width(atlas) / TEXTURE_WIDTH;
+   tiles_y = cairo_image_surface_get_height(atlas) / TEXTURE_HEIGHT;
+   if (EINA_UNLIKELY((tiles_x == 0) || (tiles_y == 0)))
+     {
+        ERR("Forest atlas is too small to hold a tile");
+        atlas_texture_close(PUD_ERA_FOREST);
+        return EINA_FALSE;
+     }
+   cairo_surface_flush(atlas);
+   atlas_px = cairo_image_surface_get_data(atlas);
+   atlas_stride = cairo_image_surface_get_stride(atlas);
+
+   ref = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+   surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+   stride = cairo_image_surface_get_stride(surf);
+
+   /* Reference: what bitmap_tile_draw() used to do */
+   cr = cairo_create(ref);
+   start = ecore_time_get();
+   for (j = 0; j < cells; ++j)
+     for (i = 0; i < cells; ++i)
+       {
+          ox = (i % tiles_x) * TEXTURE_WIDTH;
+          oy = (j % tiles_y) * TEXTURE_HEIGHT;
+          cairo_set_source_surface(cr, atlas,
+                                   (int)(i * TEXTURE_WIDTH) - (int)ox,
+                                   (int)(j * TEXTURE_HEIGHT) - (int)oy);
+          cairo_rectangle(cr, i * TEXTURE_WIDTH, j * TEXTURE_HEIGHT,
+                          TEXTURE_WIDTH, TEXTURE_HEIGHT);
+          cairo_fill(cr);
+       }
+   cairo_surface_flush(ref);
+   cairo_time = ecore_time_get() - start;
+   cairo_destroy(cr);
+   ref_px = cairo_image_surface_get_data(ref);
+   printf("blit: cairo    %8.3f ms\n", cairo_time * 1000.0);
+
+   px = cairo_image_surface_get_data(surf);
+   for (k = 0; k < EINA_C_ARRAY_LENGTH(_impls); ++k)
+     {
+        const Blit_Impl *const impl = &(_impls[k]);
+        double t;
+
+        if (!_blit_impl_supported_is(impl))
+          continue;
+
+        memset(px, 0, (size_t)stride * size);
+        start = ecore_time_get();
+        for (j = 0; j < cells; ++j)
+          for (i = 0; i < cells; ++i)
+            {
+               ox = (i % tiles_x) * TEXTURE_WIDTH;
+               oy = (j % tiles_y) * TEXTURE_HEIGHT;
+               _blit_rect_with(impl->func,
+                               px + (j * TEXTURE_HEIGHT * stride) + (i * TEXTURE_WIDTH * 4),
+                               stride,
+                               atlas_px + (oy * atlas_stride) + (ox * 4),
+                               atlas_stride,
+                               TEXTURE_WIDTH, TEXTURE_HEIGHT);
+            }
+        t = ecore_time_get() - start;
+
+        if (memcmp(px, ref_px, (size_t)stride * size) != 0)
+          {
+             ERR("Blitter %s does not match the cairo output", impl->name);
+             ok = EINA_FALSE;
+          }
+        printf("blit: %-8s %8.3f ms (x%.2f)%s\n", impl->name, t * 1000.0,
+               (t > 0.0) ? cairo_time / t : 0.0,
+               (impl == _impl) ? " [selected]" : "");
+     }
+
+   cairo_surface_destroy(surf);
+   cairo_surface_destroy(ref);
+   atlas_texture_close(PUD_ERA_FOREST);
+
+   return ok;
+}
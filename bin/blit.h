@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BLIT_H_
+#define _BLIT_H_
+
+/*
+ * Copies of opaque ARGB8888 rectangles (e.g. tiles from an atlas), without
+ * going through cairo. The row copy implementation is selected at runtime,
+ * depending on what the CPU supports.
+ */
+
+Eina_Bool blit_init(void);
+void blit_shutdown(void);
+
+void
+blit_rect(unsigned char       *dst,
+          int                  dst_stride,
+          const unsigned char *src,
+          int                  src_stride,
+          unsigned int         w,
+          unsigned int         h);
+
+void
+blit_surface(cairo_surface_t *dst,
+             int              dx,
+             int              dy,
+             cairo_surface_t *src,
+             int              sx,
+             int              sy,
+             unsigned int     w,
+             unsigned int     h);
+
+void
+blit_downsample(unsigned char       *dst,
+                int                  dst_stride,
+                const unsigned char *src,
+                int                  src_stride,
+                unsigned int         src_w,
+                unsigned int         src_h);
+
+cairo_surface_t *blit_surface_downsample(cairo_surface_t *src);
+
+const char *blit_impl_name_get(void);
+
+Eina_Bool blit_benchmark(void);
+
+#endif /* ! _BLIT_H_ */
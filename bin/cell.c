@@ -232,3 +232,25 @@ cell_unit_get(const Cell *c,
    if (owner) *owner = p;
    return EINA_TRUE;
 }
+
+Eina_Bool
+cell_unit_below_fits_is(const Cell *c)
+{
+   /*
+    * Big fat-*ss condition!
+    * When NOT to delete a unit:
+    *  - unit is marine and tile is water
+    *  - unit is flying
+    *  - unit is land and
+    *    - if unit is a building and tile is constructible
+    *    - else (unit is not a building) if tile is walkable
+    */
+   return ((c->unit_below == PUD_UNIT_NONE) ||
+           (TILE_WATER_IS(c) && pud_unit_marine_is(c->unit_below)) ||
+           (pud_unit_flying_is(c->unit_below)) ||
+           (pud_unit_land_is(c->unit_below) &&
+            ((!pud_unit_building_is(c->unit_below) &&
+              TILE_WALKABLE_IS(c)) ||
+             (pud_unit_building_is(c->unit_below) &&
+              TILE_GRASS_IS(c)))));
+}
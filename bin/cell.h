@@ -86,4 +86,7 @@ cell_unit_get(const Cell *c,
               Pud_Unit   *unit,
               Pud_Player *owner);
 
+/* Whether the unit below (if any) can stay on the tile of the cell */
+Eina_Bool cell_unit_below_fits_is(const Cell *c);
+
 #endif /* ! _CELL_H_ */
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/* Chunks around the viewport are rendered before they become visible */
+#define CHUNK_PREFETCH 256
+
+/* Default memory budget of the chunks of an editor (in MiB) */
+#define CHUNK_BUDGET_DEFAULT 64
+
+/* A chunk holds its displayed surface and its terrain layer */
+#define CHUNK_BYTES ((size_t)CHUNK_SIZE * CHUNK_SIZE * 4 * 2)
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static size_t
+_chunk_budget_get(void)
+{
+   const char *env;
+   long mib = CHUNK_BUDGET_DEFAULT;
+
+   /* Budget can be tuned, in MiB */
+   env = getenv("WAR2EDIT_BITMAP_BUDGET");
+   if (env)
+     {
+        mib = strtol(env, NULL, 10);
+        if (mib <= 0)
+          {
+             WRN("Invalid bitmap budget \"%s\". Using %i MiB",
+                 env, CHUNK_BUDGET_DEFAULT);
+             mib = CHUNK_BUDGET_DEFAULT;
+          }
+     }
+
+   return (size_t)mib * 1024 * 1024;
+}
+
+static void
+_chunk_cells_get(const Editor   *ed,
+                 const Chunk    *chunk,
+                 Eina_Rectangle *cells)
+{
+   EINA_RECTANGLE_SET(cells,
+                      chunk->geo.x / ed->bitmap.cell_w,
+                      chunk->geo.y / ed->bitmap.cell_h,
+                      chunk->geo.w / ed->bitmap.cell_w,
+                      chunk->geo.h / ed->bitmap.cell_h);
+}
+
+static void
+_chunk_evict(Editor *ed,
+             Chunk  *chunk)
+{
+   Eina_Rectangle cells;
+
+   ed->bitmap.chunks.lru = eina_inlist_remove(ed->bitmap.chunks.lru,
+                                              EINA_INLIST_GET(chunk));
+   evas_object_del(chunk->img);
+   cairo_destroy(chunk->cr);
+   cairo_surface_destroy(chunk->surf);
+   cairo_surface_destroy(chunk->terrain);
+   chunk->img = NULL;
+   chunk->cr = NULL;
+   chunk->surf = NULL;
+   chunk->terrain = NULL;
+   ed->bitmap.chunks.bytes -= CHUNK_BYTES;
+
+   /* Terrain of the chunk will have to be drawn again */
+   _chunk_cells_get(ed, chunk, &cells);
+   bitmap_terrain_invalidate(ed, &cells);
+}
+
+static Eina_Bool
+_chunk_load(Editor *ed,
+            Chunk  *chunk)
+{
+   Evas *const e = evas_object_evas_get(ed->bitmap.grid);
+   const Eina_Rectangle *const geo = &(chunk->geo);
+   Eina_Rectangle cells;
+   Evas_Object *o;
+
+   chunk->surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, geo->w, geo->h);
+   if (EINA_UNLIKELY(cairo_surface_status(chunk->surf) != CAIRO_STATUS_SUCCESS))
+     {
+        CRI("Failed to create surface for chunk %"EINA_RECTANGLE_FORMAT,
+            EINA_RECTANGLE_ARGS(geo));
+        goto fail;
+     }
+   chunk->terrain = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, geo->w, geo->h);
+   if (EINA_UNLIKELY(cairo_surface_status(chunk->terrain) != CAIRO_STATUS_SUCCESS))
+     {
+        CRI("Failed to create terrain for chunk %"EINA_RECTANGLE_FORMAT,
+            EINA_RECTANGLE_ARGS(geo));
+        goto fail_surf;
+     }
+
+   /* Drawing functions use map coordinates */
+   chunk->cr = cairo_create(chunk->surf);
+   cairo_translate(chunk->cr, -geo->x, -geo->y);
+
+   /* Debug will required text */
+   if (ed->debug != EDITOR_DEBUG_NONE)
+     {
+        cairo_select_font_face(chunk->cr, "Sans",
+                               CAIRO_FONT_SLANT_NORMAL,
+                               CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(chunk->cr, 8);
+     }
+
+   o = chunk->img = evas_object_image_filled_add(e);
+   evas_object_image_colorspace_set(o, EVAS_COLORSPACE_ARGB8888);
+   evas_object_image_size_set(o, geo->w, geo->h);
+   evas_object_image_data_set(o, cairo_image_surface_get_data(chunk->surf));
+   evas_object_pass_events_set(o, EINA_TRUE);
+   elm_grid_pack(ed->bitmap.grid, o, geo->x, geo->y, geo->w, geo->h);
+   evas_object_show(o);
+
+   ed->bitmap.chunks.lru = eina_inlist_append(ed->bitmap.chunks.lru,
+                                              EINA_INLIST_GET(chunk));
+   ed->bitmap.chunks.bytes += CHUNK_BYTES;
+
+   _chunk_cells_get(ed, chunk, &cells);
+   bitmap_refresh(ed, &cells);
+
+   return EINA_TRUE;
+
+fail_surf:
+   cairo_surface_destroy(chunk->terrain);
+   chunk->terrain = NULL;
+fail:
+   cairo_surface_destroy(chunk->surf);
+   chunk->surf = NULL;
+   return EINA_FALSE;
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+chunks_resize(Editor *ed)
+{
+   unsigned int cols, rows, i, j;
+   Chunk *chunk;
+
+   chunks_free(ed);
+
+   cols = (ed->bitmap.max_w + CHUNK_SIZE - 1) / CHUNK_SIZE;
+   rows = (ed->bitmap.max_h + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+   ed->bitmap.chunks.items = calloc(cols * rows, sizeof(Chunk));
+   if (EINA_UNLIKELY(!ed->bitmap.chunks.items))
+     {
+        CRI("Failed to allocate memory");
+        return EINA_FALSE;
+     }
+   ed->bitmap.chunks.cols = cols;
+   ed->bitmap.chunks.rows = rows;
+   ed->bitmap.chunks.budget = _chunk_budget_get();
+
+   for (j = 0; j < rows; ++j)
+     for (i = 0; i < cols; ++i)
+       {
+          chunk = &(ed->bitmap.chunks.items[(j * cols) + i]);
+          EINA_RECTANGLE_SET(&(chunk->geo), i * CHUNK_SIZE, j * CHUNK_SIZE,
+                             MIN(CHUNK_SIZE, ed->bitmap.max_w - (int)(i * CHUNK_SIZE)),
+                             MIN(CHUNK_SIZE, ed->bitmap.max_h - (int)(j * CHUNK_SIZE)));
+       }
+
+   INF("Bitmap split in %ux%u chunks. Budget is %zu bytes",
+       cols, rows, ed->bitmap.chunks.budget);
+
+   return EINA_TRUE;
+}
+
+void
+chunks_free(Editor *ed)
+{
+   Chunk *chunk;
+
+   while (ed->bitmap.chunks.lru)
+     {
+        chunk = EINA_INLIST_CONTAINER_GET(ed->bitmap.chunks.lru, Chunk);
+        _chunk_evict(ed, chunk);
+     }
+   free(ed->bitmap.chunks.items);
+   ed->bitmap.chunks.items = NULL;
+   ed->bitmap.chunks.cols = 0;
+   ed->bitmap.chunks.rows = 0;
+}
+
+void
+chunks_viewport_update(Editor *ed)
+{
+   Eina_Rectangle view, map;
+   Chunk *chunk;
+   int c1, c2, r1, r2, i, j;
+
+   if (!ed->bitmap.chunks.items) return;
+
+   elm_scroller_region_get(ed->scroller, &view.x, &view.y, &view.w, &view.h);
+   if ((view.w <= 0) || (view.h <= 0)) return;
+
+   /* Prefetch around the viewport */
+   view.x -= CHUNK_PREFETCH;
+   view.y -= CHUNK_PREFETCH;
+   view.w += 2 * CHUNK_PREFETCH;
+   view.h += 2 * CHUNK_PREFETCH;
+   EINA_RECTANGLE_SET(&map, 0, 0, ed->bitmap.max_w, ed->bitmap.max_h);
+   if (!eina_rectangle_intersection(&view, &map)) return;
+
+   c1 = view.x / CHUNK_SIZE;
+   r1 = view.y / CHUNK_SIZE;
+   c2 = (view.x + view.w - 1) / CHUNK_SIZE;
+   r2 = (view.y + view.h - 1) / CHUNK_SIZE;
+
+   /* Load chunks that are needed, and mark them as the most recently used */
+   for (j = r1; j <= r2; ++j)
+     for (i = c1; i <= c2; ++i)
+       {
+          chunk = &(ed->bitmap.chunks.items[(j * ed->bitmap.chunks.cols) + i]);
+          if (chunk->surf)
+            {
+               ed->bitmap.chunks.lru = eina_inlist_demote(ed->bitmap.chunks.lru,
+                                                          EINA_INLIST_GET(chunk));
+            }
+          else if (EINA_UNLIKELY(!_chunk_load(ed, chunk)))
+            ERR("Failed to load chunk %i,%i", i, j);
+       }
+
+   /*
+    * Evict the least recently used chunks while the budget is exceeded.
+    * Chunks that are needed are at the end of the list, so stop as soon
+    * as one of them is met.
+    */
+   while (ed->bitmap.chunks.bytes > ed->bitmap.chunks.budget)
+     {
+        chunk = EINA_INLIST_CONTAINER_GET(ed->bitmap.chunks.lru, Chunk);
+        if (eina_rectangles_intersect(&(chunk->geo), &view))
+          break;
+        _chunk_evict(ed, chunk);
+     }
+}
+
+Chunk *
+chunk_at(const Editor *ed,
+         int           x,
+         int           y)
+{
+   Chunk *chunk;
+
+   if ((x < 0) || (y < 0) ||
+       (x >= ed->bitmap.max_w) || (y >= ed->bitmap.max_h))
+     return NULL;
+
+   chunk = &(ed->bitmap.chunks.items[((y / CHUNK_SIZE) * ed->bitmap.chunks.cols) +
+                                     (x / CHUNK_SIZE)]);
+   return (chunk->surf) ? chunk : NULL;
+}
+
+size_t
+chunks_damage_upload(Editor               *ed,
+                     const Eina_Rectangle *zone)
+{
+   Eina_Rectangle r;
+   Chunk *chunk;
+   size_t bytes = 0;
+
+   EINA_INLIST_FOREACH(ed->bitmap.chunks.lru, chunk)
+     {
+        r = *zone;
+        if (eina_rectangle_intersection(&r, &(chunk->geo)))
+          {
+             evas_object_image_data_update_add(chunk->img,
+                                               r.x - chunk->geo.x,
+                                               r.y - chunk->geo.y,
+                                               r.w, r.h);
+             /* Format ARGB8888: each pixel is 4 bytes long */
+             bytes += (size_t)r.w * (size_t)r.h * 4;
+          }
+     }
+
+   return bytes;
+}
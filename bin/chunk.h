@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CHUNK_H_
+#define _CHUNK_H_
+
+/*
+ * The bitmap is not backed by one map-sized surface, but split in chunks
+ * of CHUNK_SIZE x CHUNK_SIZE pixels. Only the chunks in the viewport
+ * (plus a prefetch margin) are allocated and rendered. The others are
+ * evicted, least recently used first, when the memory budget is exceeded.
+ */
+
+#define CHUNK_SIZE 512
+
+struct _Chunk
+{
+   EINA_INLIST; /* Resident chunks, least recently used first */
+
+   Evas_Object     *img;
+   cairo_surface_t *surf;
+   cairo_surface_t *terrain;
+   cairo_t         *cr; /* Translated: uses map coordinates */
+   Eina_Rectangle   geo; /* In pixels, on the map */
+};
+
+Eina_Bool chunks_resize(Editor *ed);
+void chunks_free(Editor *ed);
+void chunks_viewport_update(Editor *ed);
+Chunk *chunk_at(const Editor *ed, int x, int y);
+size_t chunks_damage_upload(Editor *ed, const Eina_Rectangle *zone);
+
+#endif /* ! _CHUNK_H_ */
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/* Codec used when none is requested (WAR2EDIT_UNDO_CODEC) */
+#define CODEC_DEFAULT "lzma"
+
+/* Longest run of the RLE codec */
+#define CODEC_RLE_RUN_MAX 128
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static Eina_Bool
+_out_reserve(uint8_t **out,
+             size_t   *out_len,
+             size_t    size)
+{
+   uint8_t *buf;
+   size_t len = (*out_len) ? *out_len : 256;
+
+   if (size <= *out_len)
+     return EINA_TRUE;
+
+   while (len < size)
+     len *= 2;
+   buf = realloc(*out, len);
+   if (EINA_UNLIKELY(!buf))
+     return EINA_FALSE;
+   *out = buf;
+   *out_len = len;
+   return EINA_TRUE;
+}
+
+/*
+ * Raw: a plain copy
+ */
+
+static Eina_Bool
+_raw_encode(const uint8_t  *in,
+            size_t          size,
+            size_t          unit EINA_UNUSED,
+            uint8_t       **out,
+            size_t         *out_size)
+{
+   *out = malloc(size);
+   if (EINA_UNLIKELY(!*out))
+     return EINA_FALSE;
+   memcpy(*out, in, size);
+   *out_size = size;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_raw_decode(const uint8_t *in,
+            size_t         size,
+            size_t         unit EINA_UNUSED,
+            uint8_t       *out,
+            size_t         out_size)
+{
+   if (EINA_UNLIKELY(size != out_size))
+     return EINA_FALSE;
+   memcpy(out, in, size);
+   return EINA_TRUE;
+}
+
+/*
+ * RLE: runs of identical units (e.g. cells painted with the same brush).
+ * Each run starts with a byte: the high bit is set for a repeated unit,
+ * and the low bits hold the length of the run, minus one. Bytes past the
+ * last whole unit are copied as they are.
+ */
+
+static Eina_Bool
+_rle_encode(const uint8_t  *in,
+            size_t          size,
+            size_t          unit,
+            uint8_t       **out,
+            size_t         *out_size)
+{
+   const size_t units = size / unit;
+   size_t i = 0, n, len = 0, pos = 0;
+   uint8_t *buf = NULL;
+
+   while (i < units)
+     {
+        /* Repeated unit? */
+        for (n = 1;
+             (i + n < units) && (n < CODEC_RLE_RUN_MAX) &&
+             (!memcmp(&(in[i * unit]), &(in[(i + n) * unit]), unit));
+             n++);
+
+        if (n > 1)
+          {
+             if (!_out_reserve(&buf, &len, pos + 1 + unit)) goto fail;
+             buf[pos++] = 0x80 | (n - 1);
+             memcpy(&(buf[pos]), &(in[i * unit]), unit);
+             pos += unit;
+          }
+        else
+          {
+             /* Literals, until a repeated unit starts */
+             for (n = 1;
+                  (i + n < units) && (n < CODEC_RLE_RUN_MAX) &&
+                  ((i + n + 1 >= units) ||
+                   memcmp(&(in[(i + n) * unit]), &(in[(i + n + 1) * unit]), unit));
+                  n++);
+             if (!_out_reserve(&buf, &len, pos + 1 + n * unit)) goto fail;
+             buf[pos++] = (n - 1);
+             memcpy(&(buf[pos]), &(in[i * unit]), n * unit);
+             pos += n * unit;
+          }
+        i += n;
+     }
+
+   n = size - (units * unit);
+   if (!_out_reserve(&buf, &len, pos + n)) goto fail;
+   memcpy(&(buf[pos]), &(in[units * unit]), n);
+   pos += n;
+
+   *out = buf;
+   *out_size = pos;
+   return EINA_TRUE;
+
+fail:
+   free(buf);
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+_rle_decode(const uint8_t *in,
+            size_t         size,
+            size_t         unit,
+            uint8_t       *out,
+            size_t         out_size)
+{
+   const size_t units = out_size / unit;
+   size_t i = 0, pos = 0, n, k;
+
+   while (i < units)
+     {
+        if (EINA_UNLIKELY(pos >= size)) return EINA_FALSE;
+        n = (in[pos] & 0x7f) + 1;
+        if (EINA_UNLIKELY(i + n > units)) return EINA_FALSE;
+        if (in[pos++] & 0x80)
+          {
+             if (EINA_UNLIKELY(pos + unit > size)) return EINA_FALSE;
+             for (k = 0; k < n; k++)
+               memcpy(&(out[(i + k) * unit]), &(in[pos]), unit);
+             pos += unit;
+          }
+        else
+          {
+             if (EINA_UNLIKELY(pos + n * unit > size)) return EINA_FALSE;
+             memcpy(&(out[i * unit]), &(in[pos]), n * unit);
+             pos += n * unit;
+          }
+        i += n;
+     }
+
+   n = out_size - (units * unit);
+   if (EINA_UNLIKELY(pos + n != size)) return EINA_FALSE;
+   memcpy(&(out[units * unit]), &(in[pos]), n);
+   return EINA_TRUE;
+}
+
+/*
+ * LZMA. The output buffer starts at a fraction of the input, and is
+ * doubled while it is too small.
+ */
+
+static Eina_Bool
+_lzma_encode(const uint8_t  *in,
+             size_t          size,
+             const lzma_filter *filters,
+             uint8_t       **out,
+             size_t         *out_size)
+{
+   uint8_t *buf = NULL;
+   size_t len = 0, pos;
+   lzma_ret ret;
+
+   if (!_out_reserve(&buf, &len, size / 4 + 64))
+     return EINA_FALSE;
+
+   for (;;)
+     {
+        pos = 0;
+        if (filters)
+          ret = lzma_raw_buffer_encode(filters, NULL, in, size, buf, &pos, len);
+        else
+          ret = lzma_easy_buffer_encode(1, LZMA_CHECK_CRC64, NULL,
+                                        in, size, buf, &pos, len);
+        if (ret != LZMA_BUF_ERROR)
+          break;
+        if (!_out_reserve(&buf, &len, len * 2))
+          {
+             free(buf);
+             return EINA_FALSE;
+          }
+     }
+
+   if (ret != LZMA_OK)
+     {
+        ERR("LZMA encoding failed: 0x%x", ret);
+        free(buf);
+        return EINA_FALSE;
+     }
+   *out = buf;
+   *out_size = pos;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_lzma_easy_encode(const uint8_t  *in,
+                  size_t          size,
+                  size_t          unit EINA_UNUSED,
+                  uint8_t       **out,
+                  size_t         *out_size)
+{
+   return _lzma_encode(in, size, NULL, out, out_size);
+}
+
+static Eina_Bool
+_lzma_easy_decode(const uint8_t *in,
+                  size_t         size,
+                  size_t         unit EINA_UNUSED,
+                  uint8_t       *out,
+                  size_t         out_size)
+{
+   uint64_t memlimit = UINT64_MAX;
+   size_t in_pos = 0, out_pos = 0;
+   lzma_ret ret;
+
+   ret = lzma_stream_buffer_decode(&memlimit, 0, NULL, in, &in_pos, size,
+                                   out, &out_pos, out_size);
+   return ((ret == LZMA_OK) && (out_pos == out_size));
+}
+
+/*
+ * Raw LZMA2, after a delta filter over the units: similar cells that
+ * follow each other become zeroes.
+ */
+#define LZMA_DELTA_FILTERS(filters_, delta_, lzma_, unit_) \
+   lzma_options_delta delta_ = { \
+      .type = LZMA_DELTA_TYPE_BYTE, \
+      .dist = MAX(LZMA_DELTA_DIST_MIN, MIN((unit_), LZMA_DELTA_DIST_MAX)), \
+   }; \
+   lzma_options_lzma lzma_; \
+   const lzma_filter filters_[] = { \
+      { .id = LZMA_FILTER_DELTA, .options = &(delta_) }, \
+      { .id = LZMA_FILTER_LZMA2, .options = &(lzma_) }, \
+      { .id = LZMA_VLI_UNKNOWN, .options = NULL }, \
+   }; \
+   lzma_lzma_preset(&(lzma_), 1)
+
+static Eina_Bool
+_lzma_delta_encode(const uint8_t  *in,
+                   size_t          size,
+                   size_t          unit,
+                   uint8_t       **out,
+                   size_t         *out_size)
+{
+   LZMA_DELTA_FILTERS(filters, delta, lzma, unit);
+   return _lzma_encode(in, size, filters, out, out_size);
+}
+
+static Eina_Bool
+_lzma_delta_decode(const uint8_t *in,
+                   size_t         size,
+                   size_t         unit,
+                   uint8_t       *out,
+                   size_t         out_size)
+{
+   LZMA_DELTA_FILTERS(filters, delta, lzma, unit);
+   size_t in_pos = 0, out_pos = 0;
+   lzma_ret ret;
+
+   ret = lzma_raw_buffer_decode(filters, NULL, in, &in_pos, size,
+                                out, &out_pos, out_size);
+   return ((ret == LZMA_OK) && (out_pos == out_size));
+}
+
+static const Codec _codecs[] =
+{
+   { "raw",        _raw_encode,        _raw_decode        },
+   { "rle",        _rle_encode,        _rle_decode        },
+   { "lzma-delta", _lzma_delta_encode, _lzma_delta_decode },
+   { "lzma",       _lzma_easy_encode,  _lzma_easy_decode  },
+};
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+const Codec *
+codec_get(const char *name)
+{
+   unsigned int i;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(name, NULL);
+
+   for (i = 0; i < EINA_C_ARRAY_LENGTH(_codecs); ++i)
+     if (!strcmp(_codecs[i].name, name))
+       return &(_codecs[i]);
+   return NULL;
+}
+
+const Codec *
+codec_nth_get(unsigned int n)
+{
+   return (n < EINA_C_ARRAY_LENGTH(_codecs)) ? &(_codecs[n]) : NULL;
+}
+
+const Codec *
+codec_default_get(void)
+{
+   const Codec *codec;
+   const char *env;
+
+   env = getenv("WAR2EDIT_UNDO_CODEC");
+   if (env)
+     {
+        codec = codec_get(env);
+        if (codec) return codec;
+        WRN("Invalid undo codec \"%s\". Using \"%s\"", env, CODEC_DEFAULT);
+     }
+   return codec_get(CODEC_DEFAULT);
+}
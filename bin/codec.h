@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+/*
+ * Codecs of the undo history. They hold no state, and may therefore be
+ * called from worker threads. The encoders allocate their output, and
+ * grow it as needed. 'unit' is the size of the elements of the input
+ * (e.g. a cell), which some codecs take advantage of.
+ */
+
+typedef struct
+{
+   const char *name;
+
+   Eina_Bool (*encode)(const uint8_t *in, size_t size, size_t unit,
+                       uint8_t **out, size_t *out_size);
+   /* Size of the output is known: it is the size given to encode() */
+   Eina_Bool (*decode)(const uint8_t *in, size_t size, size_t unit,
+                       uint8_t *out, size_t out_size);
+} Codec;
+
+const Codec *codec_get(const char *name);
+const Codec *codec_nth_get(unsigned int n);
+const Codec *codec_default_get(void);
+
+#endif /* ! _CODEC_H_ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static void
+_damage_merge(Eina_Rectangle *acc,
+              int             x,
+              int             y,
+              int             w,
+              int             h)
+{
+   Eina_Rectangle r;
+
+   if ((w <= 0) || (h <= 0)) return;
+
+   EINA_RECTANGLE_SET(&r, x, y, w, h);
+   if (eina_rectangle_is_empty(acc))
+     *acc = r;
+   else
+     eina_rectangle_union(acc, &r);
+}
+
+static size_t
+_damage_upload(Evas_Object    *img,
+               Eina_Rectangle *zone,
+               int             max_w,
+               int             max_h)
+{
+   Eina_Rectangle bounds;
+   size_t bytes = 0;
+
+   if (eina_rectangle_is_empty(zone)) return 0;
+
+   EINA_RECTANGLE_SET(&bounds, 0, 0, max_w, max_h);
+   if (eina_rectangle_intersection(zone, &bounds))
+     {
+        evas_object_image_data_update_add(img, zone->x, zone->y,
+                                          zone->w, zone->h);
+        /* Format ARGB8888: each pixel is 4 bytes long */
+        bytes = (size_t)zone->w * (size_t)zone->h * 4;
+     }
+   EINA_RECTANGLE_SET(zone, 0, 0, 0, 0);
+
+   return bytes;
+}
+
+static Eina_Bool
+_damage_frame_cb(void *data)
+{
+   Editor *const ed = data;
+
+   ed->damage.animator = NULL;
+   damage_flush(ed);
+
+   return ECORE_CALLBACK_CANCEL;
+}
+
+static void
+_damage_schedule(Editor *ed)
+{
+   if (!ed->damage.animator)
+     ed->damage.animator = ecore_animator_add(_damage_frame_cb, ed);
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+void
+damage_bitmap_add(Editor *ed,
+                  int     x,
+                  int     y,
+                  int     w,
+                  int     h)
+{
+   _damage_merge(&(ed->damage.bitmap), x, y, w, h);
+   _damage_schedule(ed);
+}
+
+void
+damage_minimap_add(Editor *ed,
+                   int     x,
+                   int     y,
+                   int     w,
+                   int     h)
+{
+   _damage_merge(&(ed->damage.minimap), x, y, w, h);
+   _damage_schedule(ed);
+}
+
+void
+damage_flush(Editor *ed)
+{
+   size_t bytes = 0;
+
+   if (ed->damage.animator)
+     {
+        ecore_animator_del(ed->damage.animator);
+        ed->damage.animator = NULL;
+     }
+
+   if (!eina_rectangle_is_empty(&(ed->damage.bitmap)))
+     {
+        /* The bitmap is uploaded chunk per chunk */
+        bytes += chunks_damage_upload(ed, &(ed->damage.bitmap));
+        EINA_RECTANGLE_SET(&(ed->damage.bitmap), 0, 0, 0, 0);
+     }
+   bytes += _damage_upload(elm_image_object_get(ed->minimap.map),
+                           &(ed->damage.minimap),
+                           ed->pud->map_w, ed->pud->map_h);
+
+   ed->damage.frame_bytes = bytes;
+   if (bytes)
+     {
+        DBG("Frame uploaded %zu bytes", bytes);
+        stats_add(STATS_UPLOAD_BYTES, bytes);
+     }
+   if (ed->debug)
+     bitmap_debug_hud_update(ed);
+}
+
+void
+damage_del(Editor *ed)
+{
+   if (ed->damage.animator)
+     {
+        ecore_animator_del(ed->damage.animator);
+        ed->damage.animator = NULL;
+     }
+}
+
+size_t
+damage_frame_bytes_get(const Editor *ed)
+{
+   return ed->damage.frame_bytes;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _DAMAGE_H_
+#define _DAMAGE_H_
+
+/*
+ * Damage accumulator. Instead of telling evas that a whole image has
+ * changed each time something is drawn in it, zones are merged within
+ * a frame and only the resulting rectangles are uploaded when the next
+ * frame is about to be rendered.
+ */
+
+void damage_bitmap_add(Editor *ed, int x, int y, int w, int h);
+void damage_minimap_add(Editor *ed, int x, int y, int w, int h);
+void damage_flush(Editor *ed);
+void damage_del(Editor *ed);
+size_t damage_frame_bytes_get(const Editor *ed);
+
+#endif /* ! _DAMAGE_H_ */
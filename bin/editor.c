@@ -36,6 +36,16 @@ typedef struct
    uint8_t type : 2;
 } Unit_Descriptor;
 
+/* Loading is split in stripes of rows, decoded in parallel */
+typedef struct
+{
+   Editor       *ed;
+   unsigned int  stripe_h;
+} Editor_Load;
+
+/* Rows per stripe, at least */
+#define EDITOR_LOAD_STRIPE_MIN 8
+
 
 static Eina_List *_editors = NULL;
 static unsigned int _eds = 0;
@@ -169,6 +179,7 @@ _scroll_cb(void        *data,
 {
    Editor *const ed = data;
    bitmap_minimap_view_resize(ed);
+   chunks_viewport_update(ed);
 }
 
 static void
@@ -187,11 +198,12 @@ _key_down_cb(void        *data,
      {
         if (!strcmp(ev->key, "plus"))
           {
-             ed->zoom += 0.25;
+             if (bitmap_zoom_get(ed) > 0)
+               bitmap_zoom_set(ed, bitmap_zoom_get(ed) - 1);
           }
         else if (!strcmp(ev->key, "minus"))
           {
-             ed->zoom -= 0.25;
+             bitmap_zoom_set(ed, bitmap_zoom_get(ed) + 1);
           }
      }
    else
@@ -327,6 +339,83 @@ _unit_show_cb(void        *data,
    elm_scroller_region_bring_in(ed->scroller, x - w/2, y - h/2, w, h);
 }
 
+/*
+ * Decodes the tiles of a stripe into the cells. This is what
+ * bitmap_tile_set() does when loading (tiles are never randomized, no
+ * wall is replaced), without the minimap, which is rendered once all
+ * stripes are done.
+ */
+static void
+_load_stripe_cb(void         *data,
+                unsigned int  job)
+{
+   const Editor_Load *const l = data;
+   Editor *const ed = l->ed;
+   const Pud *const pud = ed->pud;
+   const unsigned int y1 = job * l->stripe_h;
+   const unsigned int y2 = MIN(y1 + l->stripe_h, pud->map_h);
+   unsigned int i, j;
+   uint8_t bl = 0, br = 0, tl = 0, tr = 0, seed = 0;
+   Cell *c;
+
+   for (j = y1; j < y2; j++)
+     for (i = 0; i < pud->map_w; i++)
+       {
+          c = &(ed->cells[j][i]);
+          tile_decompose(pud_tile_get(pud, i, j), &tl, &tr, &bl, &br, &seed);
+          c->tile_tl = tl;
+          c->tile_tr = tr;
+          c->tile_bl = bl;
+          c->tile_br = br;
+          c->tile = tile_calculate(tl, tr, bl, br, seed, pud->era, NULL);
+       }
+}
+
+static inline void
+_maps_cell_sync(Editor       *ed,
+                unsigned int  k)
+{
+   const Cell *const c = &(ed->cells[k / ed->pud->map_w][k % ed->pud->map_w]);
+
+   ed->pud->action_map[k] = TILE_ACTION_GET(c);
+   ed->pud->movement_map[k] = TILE_MOVEMENT_GET(c);
+}
+
+/*
+ * Drains the dirty cells: only the tiles changed since the last sync
+ * have their action and movement maps computed again.
+ */
+static void
+_maps_sync(Editor *ed)
+{
+   const unsigned int cells = ed->pud->map_w * ed->pud->map_h;
+   unsigned int w, k, words;
+   uint32_t bits;
+
+   if (ed->maps.all || !ed->maps.dirty)
+     {
+        for (k = 0; k < cells; k++)
+          _maps_cell_sync(ed, k);
+        ed->maps.all = EINA_FALSE;
+        if (ed->maps.dirty)
+          memset(ed->maps.dirty, 0, ((cells + 31) / 32) * sizeof(uint32_t));
+        return;
+     }
+
+   words = (cells + 31) / 32;
+   for (w = 0; w < words; w++)
+     {
+        bits = ed->maps.dirty[w];
+        if (!bits) continue;
+        ed->maps.dirty[w] = 0;
+        for (k = w * 32; bits; k++, bits >>= 1)
+          {
+             if (bits & 1)
+               _maps_cell_sync(ed, k);
+          }
+     }
+}
+
 /*============================================================================*
  *                                 Public API                                 *
  *============================================================================*/
@@ -334,6 +423,9 @@ _unit_show_cb(void        *data,
 Eina_Bool
 editor_init(void)
 {
+   /* Tiles are composed and decomposed through tables */
+   tile_tables_init();
+
    _itc = elm_genlist_item_class_new();
    _itc->item_style = "default";
    _itc->func.text_get = _text_get_cb;
@@ -374,6 +466,9 @@ editor_free(Editor *ed)
    EINA_SAFETY_ON_NULL_RETURN(ed);
 
    _editors = eina_list_remove(_editors, ed);
+   damage_del(ed);
+   unitindex_free(ed);
+   free(ed->maps.dirty);
    cell_matrix_free(ed->cells);
    pud_close(ed->pud);
    minimap_del(ed);
@@ -681,15 +776,24 @@ editor_new(const char   *pud_file,
    ed->saved = EINA_TRUE;
 
    ed->debug = debug;
-   ed->zoom = 1.0;
 
      // FIXME cleanup on error + set max size
    ed->orc_menus = eina_array_new(4);
    ed->human_menus = eina_array_new(4);
 
+   /* Random streams: one for the edition, one for the generators */
+   ed->seed = prng_seed_default();
+   prng_init(&(ed->prng), ed->seed, EDITOR_PRNG_STREAM_EDIT);
+   prng_init(&(ed->prng_gen), ed->seed, EDITOR_PRNG_STREAM_GENERATOR);
+   INF("Editor uses seed %llu (set WAR2EDIT_SEED to reproduce)",
+       (unsigned long long)ed->seed);
+
    /* No previous click */
    ed->prev_x = -1;
    ed->prev_y = -1;
+   ed->wall_from.x = -1;
+   ed->wall_from.y = -1;
+   ed->fill_action = EDITOR_SEL_ACTION_GRASS;
 
    for (i = 0; i < 8; i++)
      {
@@ -986,6 +1090,23 @@ editor_tiles_sync(Editor *ed)
    return EINA_TRUE;
 }
 
+Eina_Bool
+editor_maps_reset(Editor *ed)
+{
+   const unsigned int cells = ed->pud->map_w * ed->pud->map_h;
+
+   /* All the cells are new: everything will be synced */
+   free(ed->maps.dirty);
+   ed->maps.dirty = calloc((cells + 31) / 32, sizeof(uint32_t));
+   ed->maps.all = EINA_TRUE;
+   if (EINA_UNLIKELY(!ed->maps.dirty))
+     {
+        CRI("Failed to allocate memory");
+        return EINA_FALSE;
+     }
+   return EINA_TRUE;
+}
+
 Eina_Bool
 editor_sync(Editor *ed)
 {
@@ -1076,10 +1197,6 @@ editor_sync(Editor *ed)
               * and this function if much less performant... */
              pud->tiles_map[k] = c->tile;
 
-             /* Determine action and movement map */
-             pud->action_map[k] = TILE_ACTION_GET(c);
-             pud->movement_map[k] = TILE_MOVEMENT_GET(c);
-
              k++;
           }
      }
@@ -1097,6 +1214,8 @@ editor_sync(Editor *ed)
         goto fail;
      }
 
+   _maps_sync(ed);
+
    return EINA_TRUE;
 
 fail:
@@ -1127,6 +1246,8 @@ editor_load(Editor     *ed,
 
    DBG("Loading \"%s\"", file);
 
+   /* History was about the previous map */
+   snapshot_clear(ed);
    if (ed->pud) pud_close(ed->pud);
    ed->pud = pud_open(file, PUD_OPEN_MODE_R | PUD_OPEN_MODE_W);
    if (EINA_UNLIKELY(!ed->pud))
@@ -1141,7 +1262,7 @@ editor_load(Editor     *ed,
    sprite_buildings_open(pud->era);
 
    if (!ed->minimap.map) minimap_add(ed);
-   if (!ed->bitmap.img) bitmap_add(ed);
+   if (!ed->bitmap.grid) bitmap_add(ed);
    else bitmap_resize(ed);
 
    count = pud->units_count;
@@ -1483,6 +1604,9 @@ editor_player_switch_race(Editor     *ed,
      for (i = 0; i < ed->pud->map_w; i++)
        {
           c = &(ed->cells[j][i]);
+          if ((c->player_above == player) || (c->player_below == player) ||
+              (c->start_location == player))
+            snapshot_cell_touch(ed, i, j);
           if (c->player_above == player)
             c->unit_above = pud_unit_switch_side(c->unit_above);
           if (c->player_below == player)
@@ -1760,26 +1884,25 @@ void
 editor_partial_load(Editor *ed)
 {
    const Pud *const pud = ed->pud;
-   unsigned int i, j, sw, sh;
-   uint16_t tile;
-   uint8_t bl, br, tl, tr, seed;
+   unsigned int i, sw, sh, stripes;
+   Editor_Load l;
    Pud_Unit_Info *u;
 
-   // TODO split the map into parts, and do a parallel load
-   for (j = 0; j < pud->map_h; j++)
-     for (i = 0; i < pud->map_w; i++)
-       {
-          tile = pud_tile_get(pud, i, j);
-          tile_decompose(tile, &tl, &tr, &bl, &br, &seed);
-          bitmap_tile_set(ed, i, j, tl, tr, bl, br, seed, EINA_FALSE);
-       }
+   /* Tiles of the cells are independent: decode them in parallel */
+   l.ed = ed;
+   stripes = parallel_workers_get() * 2;
+   l.stripe_h = MAX((pud->map_h + stripes - 1) / stripes,
+                    EDITOR_LOAD_STRIPE_MIN);
+   stripes = (pud->map_h + l.stripe_h - 1) / l.stripe_h;
+   parallel_run(stripes, _load_stripe_cb, &l);
+   editor_maps_dirty_all(ed);
 
    for (i = 0; i < pud->units_count; ++i)
      {
         u = &(pud->units[i]);
         sprite_tile_size_get(u->type, &sw, &sh);
         bitmap_unit_set(ed, u->type, u->player,
-                        sprite_info_random_get(), u->x, u->y, sw, sh,
+                        sprite_info_random_get(&(ed->prng)), u->x, u->y, sw, sh,
                         u->alter);
      }
    bitmap_refresh(ed, NULL);
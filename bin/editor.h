@@ -23,6 +23,10 @@
 #ifndef _EDITOR_H_
 #define _EDITOR_H_
 
+/* Random streams of an editor */
+#define EDITOR_PRNG_STREAM_EDIT       0
+#define EDITOR_PRNG_STREAM_GENERATOR  1
+
 typedef uint16_t Editor_Sel;
 
 #define EDITOR_SEL_NONE                      ((Editor_Sel) 0)
@@ -54,6 +58,7 @@ typedef uint16_t Editor_Sel;
 #define EDITOR_SEL_ACTION_ROCKS              ((Editor_Sel) (0x07 << 6))
 #define EDITOR_SEL_ACTION_HUMAN_WALLS        ((Editor_Sel) (0x08 << 6))
 #define EDITOR_SEL_ACTION_ORC_WALLS          ((Editor_Sel) (0x09 << 6))
+#define EDITOR_SEL_ACTION_FILL               ((Editor_Sel) (0x0a << 6))
 #define EDITOR_SEL_ACTION_MASK               ((Editor_Sel) (0x0f << 6))
 
 
@@ -112,6 +117,30 @@ struct _Editor
       float           ratio;
    } minimap;
 
+   struct {
+      Eina_Rectangle  bitmap; /* In pixels */
+      Eina_Rectangle  minimap; /* In cells */
+      Ecore_Animator *animator;
+      size_t          frame_bytes;
+   } damage;
+
+   /* Debug overlay, showing the statistics of the last frame */
+   struct {
+      Evas_Object *text;
+      uint64_t     last[__STATS_LAST];
+   } hud;
+
+   struct {
+      Unitindex_Entry **units; /* Per anchor and layer */
+      Eina_List       **buckets;
+      Eina_Inarray     *visible; /* Units found by the last query */
+      unsigned int      cols;
+      unsigned int      rows;
+      unsigned int      map_w;
+      unsigned int      map_h;
+      unsigned int      stamp;
+   } unitindex;
+
    struct {
       Evas_Object *sel[3];
       unsigned int x, y;
@@ -139,11 +168,20 @@ struct _Editor
    Eina_Array  *human_menus;
 
    struct {
-      Eina_Inlist *items;
+      Eina_Inlist *items; /* Undo stack */
       Eina_Inlist *redos;
-      uint8_t *buffer;
+      Snapshot_Record *journal; /* Cells touched by the pending edits */
+      unsigned int journal_count;
+      unsigned int journal_size;
+      uint32_t *touched; /* Bitset of the cells in the journal */
+      unsigned int cells; /* Size of the map, in cells */
+      unsigned int depth; /* Nested transactions */
+      Ecore_Timer *timer;
+      uint8_t *buffer; /* Decompressed records */
       size_t buf_len;
-      int requests;
+      size_t bytes[2]; /* Held by the undo and redo stacks */
+      size_t budget;
+      const Codec *codec; /* Of the large entries */
    } snapshot;
 
    Elm_Object_Item *gen_group_players[8];
@@ -160,7 +198,11 @@ struct _Editor
    Evas_Point  start_locations[8];
 
    unsigned int    debug;
-   double zoom;
+
+   /* Random streams. They are all split from the seed */
+   uint64_t seed;
+   Prng     prng;     /* Variants of tiles and sprites */
+   Prng     prng_gen; /* Seeds of generated maps */
 
    int mainconfig;
    /* Used to avoid setting tiles in the same cell every time
@@ -169,6 +211,21 @@ struct _Editor
    int prev_y;
    Eina_Bool was_oob;
 
+   /* First cell of the wall segment being drawn. x is -1 if none */
+   Evas_Point wall_from;
+
+   /* Terrain the fill action paints with: the last one selected */
+   Editor_Sel fill_action;
+
+   /*
+    * Cells whose action and movement maps are out of date (one bit per
+    * cell). They are computed again when syncing to the pud.
+    */
+   struct {
+      uint32_t  *dirty;
+      Eina_Bool  all;
+   } maps;
+
    Eina_Bool saved;
 };
 
@@ -229,6 +286,22 @@ editor_sel_action_get(const Editor * ed)
    return ed->tb_sel & EDITOR_SEL_ACTION_MASK;
 }
 
+static inline void
+editor_maps_dirty_set(Editor       *ed,
+                      unsigned int  x,
+                      unsigned int  y)
+{
+   const unsigned int k = (y * ed->pud->map_w) + x;
+   if (ed->maps.dirty)
+     ed->maps.dirty[k >> 5] |= (uint32_t)1 << (k & 31);
+}
+
+static inline void
+editor_maps_dirty_all(Editor *ed)
+{
+   ed->maps.all = EINA_TRUE;
+}
+
 Eina_Bool editor_init(void);
 void editor_shutdown(void);
 
@@ -244,6 +317,7 @@ uint16_t
 editor_alter_defaults_get(const Editor *ed,
                           const Pud_Unit          unit);
 Eina_Bool editor_sync(Editor *ed);
+Eina_Bool editor_maps_reset(Editor *ed);
 
 void editor_notif_send(Editor *ed, const char *msg, ...) EINA_PRINTF(2,3);
 
@@ -37,6 +37,9 @@ static const Ecore_Getopt _options =
    EINA_TRUE,
    {
       ECORE_GETOPT_STORE_TRUE('d', "debug", "Enable graphical debug"),
+      ECORE_GETOPT_STORE_TRUE('b', "benchmark", "Run the internal benchmarks and exit"),
+      ECORE_GETOPT_STORE_TRUE('s', "stats", "Periodically log rendering statistics"),
+      ECORE_GETOPT_STORE_TRUE('r', "repair", "Repair the terrain of the PUD file(s) and exit"),
       ECORE_GETOPT_HELP ('h', "help"),
       ECORE_GETOPT_VERSION('V', "version"),
       ECORE_GETOPT_SENTINEL
@@ -55,6 +58,9 @@ static const Module _modules[] =
 {
 #define MODULE(name_) { #name_, name_ ## _init, name_ ## _shutdown }
    MODULE(log),
+   MODULE(stats),
+   MODULE(blit),
+   MODULE(parallel),
    MODULE(atlas),
    MODULE(sprite),
    MODULE(menu),
@@ -81,6 +87,56 @@ _edje_get(const char *theme)
    return (_edje_file == NULL) ? EINA_FALSE : EINA_TRUE;
 }
 
+/*
+ * Repairs each file in place, without editor. The random variants of
+ * the repaired tiles are drawn from the default seed.
+ */
+static Eina_Bool
+_repair_files(char         **files,
+              unsigned int   count)
+{
+   Pud *pud;
+   Prng prng;
+   unsigned int i, changed;
+   Eina_Bool ok = EINA_TRUE;
+
+   if (count == 0)
+     {
+        ERR("No PUD file to repair");
+        return EINA_FALSE;
+     }
+
+   prng_init(&prng, prng_seed_default(), 0);
+
+   for (i = 0; i < count; ++i)
+     {
+        pud = pud_open(files[i], PUD_OPEN_MODE_RW);
+        if (EINA_UNLIKELY(!pud))
+          {
+             ERR("Failed to open file \"%s\"", files[i]);
+             ok = EINA_FALSE;
+             continue;
+          }
+
+        if (!terrain_repair_pud(pud, &prng, &changed))
+          {
+             ERR("Failed to repair the terrain of \"%s\"", files[i]);
+             ok = EINA_FALSE;
+          }
+        else if ((changed > 0) && (!pud_write(pud, files[i])))
+          {
+             ERR("Failed to write file \"%s\"", files[i]);
+             ok = EINA_FALSE;
+          }
+        else
+          printf("%s: %u cell%s changed\n", files[i], changed,
+                 (changed == 1) ? "" : "s");
+        pud_close(pud);
+     }
+
+   return ok;
+}
+
 EAPI_MAIN int
 elm_main(int    argc,
          char **argv)
@@ -92,8 +148,14 @@ elm_main(int    argc,
    unsigned int ed_count = 0;
    Eina_Bool quit_opt = EINA_FALSE;
    Eina_Bool debug = EINA_FALSE;
+   Eina_Bool bench = EINA_FALSE;
+   Eina_Bool stats = EINA_FALSE;
+   Eina_Bool repair = EINA_FALSE;
    Ecore_Getopt_Value values[] = {
       ECORE_GETOPT_VALUE_BOOL(debug),
+      ECORE_GETOPT_VALUE_BOOL(bench),
+      ECORE_GETOPT_VALUE_BOOL(stats),
+      ECORE_GETOPT_VALUE_BOOL(repair),
       ECORE_GETOPT_VALUE_BOOL(quit_opt),
       ECORE_GETOPT_VALUE_BOOL(quit_opt)
    };
@@ -145,6 +207,24 @@ elm_main(int    argc,
          }
      }
 
+   /* Benchmarks don't need any editor */
+   if (bench)
+     {
+        if (blit_benchmark() & tile_benchmark() & snapshot_benchmark())
+          ret = EXIT_SUCCESS;
+        goto modules_shutdown;
+     }
+
+   /* Neither does the repair of files */
+   if (repair)
+     {
+        if (_repair_files(&(argv[args]), argc - args))
+          ret = EXIT_SUCCESS;
+        goto modules_shutdown;
+     }
+
+   if (stats)
+     stats_dump_start(STATS_DUMP_INTERVAL);
 
    /* Open editors for each specified files */
    for (i = args; i < argc; ++i)
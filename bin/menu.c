@@ -191,6 +191,10 @@ _generator_func(Editor *ed,
 {
    Plugin_Generator_Func func;
    float *map;
+   uint8_t *classes;
+   uint64_t env_seed;
+   uint32_t seed;
+   Prng prng;
    struct {
       Tile tile;
       float limit;
@@ -214,7 +218,17 @@ _generator_func(Editor *ed,
         return;
      }
 
-   map = func(ed->pud->map_w, ed->pud->map_h, 0.1, 4);
+   /*
+    * Everything random in a map comes from its own seed, so it can be
+    * generated again with WAR2EDIT_MAP_SEED.
+    */
+   if (prng_seed_env_get("WAR2EDIT_MAP_SEED", &env_seed))
+     seed = (uint32_t)env_seed;
+   else
+     seed = prng_next(&(ed->prng_gen));
+   prng_init(&prng, seed, EDITOR_PRNG_STREAM_GENERATOR);
+   INF("Generating a map with seed %u", seed);
+   map = func(ed->pud->map_w, ed->pud->map_h, 0.1, 4, seed);
    if (EINA_UNLIKELY(!map))
      {
         CRI("Failed to create random map");
@@ -230,7 +244,7 @@ _generator_func(Editor *ed,
    while (1)
      {
         for (l = 0; l < EINA_C_ARRAY_LENGTH(ctor); l++)
-          ctor[l].limit = drand48();
+          ctor[l].limit = prng_float(&prng);
 
         for (k = 0, l = 0; l < EINA_C_ARRAY_LENGTH(ctor) - 1; l++)
           {
@@ -247,27 +261,46 @@ _generator_func(Editor *ed,
      printf("%f\n", (double)ctor[l].limit);
 #endif
 
+   classes = malloc(ed->pud->map_w * ed->pud->map_h);
+   if (EINA_UNLIKELY(!classes))
+     {
+        CRI("Failed to allocate memory");
+        free(map);
+        return;
+     }
+   for (k = 0; k < ed->pud->map_w * ed->pud->map_h; k++)
+     {
+        for (l = 0; l < EINA_C_ARRAY_LENGTH(ctor); l++)
+          {
+             if (map[k] <= ctor[l].limit)
+               break;
+          }
+        /* Above all limits: the cell is left as it is */
+        classes[k] = (l < EINA_C_ARRAY_LENGTH(ctor)) ? ctor[l].tile : TILE_NONE;
+     }
+
    snapshot_push(ed);
-   for (j = 0; j < ed->pud->map_h; j++)
-     for (i = 0; i < ed->pud->map_w; i++)
-       {
-          for (l = 0; l < EINA_C_ARRAY_LENGTH(ctor); l++)
+   if (!terrain_solve(ed, classes, &prng))
+     {
+        WRN("Falling back to placing the tiles one by one");
+        for (k = 0, j = 0; j < ed->pud->map_h; j++)
+          for (i = 0; i < ed->pud->map_w; i++, k++)
             {
-               if (map[k] <= ctor[l].limit)
-                 {
-                    bitmap_tile_set(ed, i, j,
-                                    ctor[l].tile, ctor[l].tile,
-                                    ctor[l].tile, ctor[l].tile,
-                                    TILE_RANDOMIZE, EINA_TRUE);
-                    bitmap_tile_calculate(ed, i, j, NULL);
-                    break;
-                 }
+               if (classes[k] == TILE_NONE)
+                 continue;
+               bitmap_tile_set(ed, i, j,
+                               classes[k], classes[k],
+                               classes[k], classes[k],
+                               TILE_RANDOMIZE, EINA_TRUE);
+               bitmap_tile_calculate(ed, i, j, NULL);
             }
-
-          k++;
-       }
+     }
    snapshot_push_done(ed);
+   free(classes);
    free(map);
+
+   editor_notif_send(ed, "Map generated with seed %u "
+                     "(set WAR2EDIT_MAP_SEED to generate it again)", seed);
 }
 
 static inline void
@@ -295,6 +328,31 @@ _randomize_cb(void        *data,
    _render_unlock(ed);
 }
 
+static void
+_repair_cb(void        *data,
+           Evas_Object *obj   EINA_UNUSED,
+           void        *event EINA_UNUSED)
+{
+   Editor *const ed = data;
+   unsigned int changed = 0;
+   Eina_Bool ok;
+
+   bitmap_render_lock(ed);
+   snapshot_push(ed);
+   ok = terrain_repair(ed, &changed);
+   snapshot_push_done(ed);
+   _render_unlock(ed);
+
+   if (!ok)
+     editor_notif_send(ed, "Failed to repair the map");
+   else
+     {
+        editor_notif_send(ed, "Map repaired: %u cell%s changed",
+                          changed, (changed == 1) ? "" : "s");
+        if (changed > 0) editor_changed(ed);
+     }
+}
+
 static void
 _map_properties_cb(void        *data,
                    Evas_Object *obj   EINA_UNUSED,
@@ -610,6 +668,9 @@ menu_properties_add(Editor *ed)
    elm_menu_item_add(m, NULL, NULL, "Upgrades Properties...", _upgrades_properties_cb, ed);
    elm_menu_item_add(m, NULL, NULL, "Allow Properties...", _allow_properties_cb, ed);
 
+   elm_menu_item_separator_add(m, NULL);
+   elm_menu_item_add(m, NULL, NULL, "Repair Map", _repair_cb, ed);
+
    return EINA_TRUE;
 }
 
@@ -706,7 +767,7 @@ _era_changed_cb(void        *data,
 
    pud_era_set(ed->pud, era);
 
-   if (ed->bitmap.img)
+   if (ed->bitmap.grid)
      bitmap_refresh(ed, NULL);
    if (ed->minimap.map)
      minimap_reload(ed);
@@ -245,6 +245,7 @@ minimap_update(Editor       *ed,
 
    if (ed->bitmap.norender) return EINA_FALSE;
 
+   stats_add(STATS_MINIMAP_CELLS, 1);
    if (c->unit_above != PUD_UNIT_NONE)
      {
         player = c->player_above;
@@ -305,8 +306,7 @@ minimap_render(Editor *ed,
                unsigned int  h)
 {
    if (ed->bitmap.norender) return;
-   evas_object_image_data_update_add(elm_image_object_get(ed->minimap.map),
-                                     x, y, w, h);
+   damage_minimap_add(ed, x, y, w, h);
 }
 
 void
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+typedef struct
+{
+   Eina_Lock       lock;
+   Eina_Condition  cond;
+   Parallel_Cb     cb;
+   void           *data;
+   unsigned int    jobs;
+   unsigned int    next; /* Next job to be taken */
+   unsigned int    done; /* Jobs completed */
+   unsigned int    refs; /* The caller and the workers not yet ended */
+} Parallel;
+
+static unsigned int _workers = 1;
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static void
+_parallel_unref(Parallel *p)
+{
+   unsigned int refs;
+
+   eina_lock_take(&(p->lock));
+   refs = --p->refs;
+   eina_lock_release(&(p->lock));
+
+   /*
+    * A worker may have been queued behind other threads and start after
+    * all jobs are done: the context is released by whoever is last.
+    */
+   if (refs == 0)
+     {
+        eina_condition_free(&(p->cond));
+        eina_lock_free(&(p->lock));
+        free(p);
+     }
+}
+
+static void
+_parallel_work(Parallel *p)
+{
+   unsigned int job;
+
+   eina_lock_take(&(p->lock));
+   while (p->next < p->jobs)
+     {
+        job = p->next++;
+        eina_lock_release(&(p->lock));
+
+        p->cb(p->data, job);
+
+        eina_lock_take(&(p->lock));
+        if (++p->done == p->jobs)
+          eina_condition_broadcast(&(p->cond));
+     }
+   eina_lock_release(&(p->lock));
+}
+
+static void
+_parallel_thread_cb(void         *data,
+                    Ecore_Thread *thread EINA_UNUSED)
+{
+   Parallel *const p = data;
+
+   _parallel_work(p);
+   _parallel_unref(p);
+}
+
+
+/*============================================================================*
+ *                                Init/Shutdown                               *
+ *============================================================================*/
+
+Eina_Bool
+parallel_init(void)
+{
+   const char *env;
+   int max;
+
+   max = ecore_thread_max_get();
+
+   /* Allows to limit the workers (e.g. 1 for comparisons) */
+   env = getenv("WAR2EDIT_THREADS");
+   if (env)
+     {
+        max = atoi(env);
+        if (max <= 0)
+          {
+             WRN("Invalid number of threads \"%s\". Using 1.", env);
+             max = 1;
+          }
+     }
+   _workers = (max > 0) ? (unsigned int)max : 1;
+   INF("Parallel jobs will use up to %u threads", _workers);
+
+   return EINA_TRUE;
+}
+
+void
+parallel_shutdown(void)
+{
+   _workers = 1;
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+unsigned int
+parallel_workers_get(void)
+{
+   return _workers;
+}
+
+void
+parallel_run(unsigned int  jobs,
+             Parallel_Cb   cb,
+             void         *data)
+{
+   EINA_SAFETY_ON_NULL_RETURN(cb);
+
+   Parallel *p;
+   unsigned int i, threads;
+   int available;
+
+   /* The caller is one of the workers */
+   available = ecore_thread_available_get();
+   threads = MIN(_workers, jobs);
+   if ((available >= 0) && ((unsigned int)available + 1 < threads))
+     threads = available + 1;
+
+   if (threads <= 1)
+     goto serial;
+
+   p = calloc(1, sizeof(*p));
+   if (EINA_UNLIKELY(!p))
+     {
+        CRI("Failed to allocate memory");
+        goto serial;
+     }
+   if (EINA_UNLIKELY(!eina_lock_new(&(p->lock))))
+     {
+        CRI("Failed to create lock");
+        free(p);
+        goto serial;
+     }
+   if (EINA_UNLIKELY(!eina_condition_new(&(p->cond), &(p->lock))))
+     {
+        CRI("Failed to create condition");
+        eina_lock_free(&(p->lock));
+        free(p);
+        goto serial;
+     }
+   p->cb = cb;
+   p->data = data;
+   p->jobs = jobs;
+   p->refs = threads;
+
+   for (i = 1; i < threads; ++i)
+     {
+        /* If the thread cannot be created, the job is run right away */
+        ecore_thread_run(_parallel_thread_cb, NULL, NULL, p);
+     }
+
+   _parallel_work(p);
+
+   eina_lock_take(&(p->lock));
+   while (p->done < p->jobs)
+     eina_condition_wait(&(p->cond));
+   eina_lock_release(&(p->lock));
+
+   _parallel_unref(p);
+   return;
+
+serial:
+   for (i = 0; i < jobs; ++i)
+     cb(data, i);
+}
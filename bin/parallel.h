@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/*
+ * Runs independent jobs on the ecore_thread pool. The caller is blocked
+ * until all jobs are done, and takes part in the work meanwhile. Jobs
+ * must not use the main loop, nor any evas or elementary object.
+ */
+
+typedef void (*Parallel_Cb)(void *data, unsigned int job);
+
+Eina_Bool parallel_init(void);
+void parallel_shutdown(void);
+
+unsigned int parallel_workers_get(void);
+void parallel_run(unsigned int jobs, Parallel_Cb cb, void *data);
+
+#endif /* ! _PARALLEL_H_ */
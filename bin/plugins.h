@@ -27,7 +27,8 @@
 
 #define PLUGIN_GENERATOR_FUNC_SYMBOL "generator"
 
-typedef float *(*Plugin_Generator_Func)(unsigned int, unsigned int, float, unsigned int);
+/* width, height, frequency, depth, seed. The same seed gives the same map */
+typedef float *(*Plugin_Generator_Func)(unsigned int, unsigned int, float, unsigned int, uint32_t);
 
 Eina_Bool plugins_init(void);
 void plugins_shutdown(void);
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static uint64_t
+_splitmix64(uint64_t *x)
+{
+   uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+   return z ^ (z >> 31);
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+prng_seed_env_get(const char *var,
+                  uint64_t   *seed)
+{
+   const char *env;
+   char *end;
+   unsigned long long val;
+
+   env = getenv(var);
+   if (!env)
+     return EINA_FALSE;
+
+   val = strtoull(env, &end, 0);
+   if ((*env == '\0') || (*end != '\0'))
+     {
+        WRN("Invalid seed \"%s\" in %s. Ignoring.", env, var);
+        return EINA_FALSE;
+     }
+   *seed = (uint64_t)val;
+   return EINA_TRUE;
+}
+
+uint64_t
+prng_seed_default(void)
+{
+   uint64_t seed;
+
+   /* Allows to reproduce a session (e.g. edits, benchmarks) */
+   if (prng_seed_env_get("WAR2EDIT_SEED", &seed))
+     return seed;
+
+   return (uint64_t)(ecore_time_unix_get() * 1000000.0);
+}
+
+void
+prng_init(Prng     *p,
+          uint64_t  seed,
+          uint64_t  stream)
+{
+   uint64_t x, a, b;
+
+   /* Each stream starts from a seed scrambled with its number */
+   x = seed ^ _splitmix64(&stream);
+   a = _splitmix64(&x);
+   b = _splitmix64(&x);
+   p->s[0] = (uint32_t)a;
+   p->s[1] = (uint32_t)(a >> 32);
+   p->s[2] = (uint32_t)b;
+   p->s[3] = (uint32_t)(b >> 32);
+
+   /* The state must not be all zeros */
+   if (!(p->s[0] | p->s[1] | p->s[2] | p->s[3]))
+     p->s[0] = 1;
+}
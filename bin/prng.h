@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _PRNG_H_
+#define _PRNG_H_
+
+/*
+ * Small and fast pseudo-random generator (xoshiro128**). Each editor
+ * owns its streams, split from one seed, so random choices do not depend
+ * on shared state and can be reproduced from the seed. Streams are not
+ * thread-safe: workers must be given their own.
+ */
+
+typedef struct
+{
+   uint32_t s[4];
+} Prng;
+
+/* Seed used for new editors: WAR2EDIT_SEED if set, or from the clock */
+uint64_t prng_seed_default(void);
+
+/* Seed held by the environment variable 'var'. EINA_FALSE if unset */
+Eina_Bool prng_seed_env_get(const char *var, uint64_t *seed);
+
+/* Initializes the stream number 'stream' of the sequence of 'seed' */
+void prng_init(Prng *p, uint64_t seed, uint64_t stream);
+
+static inline uint32_t
+prng_rotl(uint32_t x,
+          int      k)
+{
+   return (x << k) | (x >> (32 - k));
+}
+
+static inline uint32_t
+prng_next(Prng *p)
+{
+   uint32_t *const s = p->s;
+   const uint32_t result = prng_rotl(s[1] * 5, 7) * 9;
+   const uint32_t t = s[1] << 9;
+
+   s[2] ^= s[0];
+   s[3] ^= s[1];
+   s[1] ^= s[2];
+   s[0] ^= s[3];
+   s[2] ^= t;
+   s[3] = prng_rotl(s[3], 11);
+
+   return result;
+}
+
+/* Uniform in [0; n[ */
+static inline uint32_t
+prng_below(Prng     *p,
+           uint32_t  n)
+{
+   return (uint32_t)(((uint64_t)prng_next(p) * n) >> 32);
+}
+
+/* Uniform in [0; 1[ */
+static inline float
+prng_float(Prng *p)
+{
+   return (float)(prng_next(p) >> 8) * (1.0f / 16777216.0f);
+}
+
+#endif /* ! _PRNG_H_ */
@@ -20,215 +20,802 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+
 #include "war2edit.h"
 
-#define SNAPSHOT_MAX 16
+/* Default memory budgets of the histories (in MiB) */
+#define SNAPSHOT_BUDGET_DEFAULT 32 /* Per editor */
+#define SNAPSHOT_BUDGET_TOTAL_DEFAULT 128 /* All editors */
+
+/* Entries larger than this are compressed by a worker thread */
+#define SNAPSHOT_COMPRESS_MIN (1 << 14) /* 16KiB */
+
+/* Edits done within this delay (in seconds) are undone at once */
+#define SNAPSHOT_DELAY 1.0
+
+/* A cell, before and after an entry */
+struct _Snapshot_Record
+{
+   uint32_t cell; /* y * map_w + x */
+   Cell     before;
+   Cell     after;
+};
+
+typedef struct _Snapshot_Job Snapshot_Job;
 
 typedef struct
 {
    EINA_INLIST;
 
-   uint8_t *mem;
-   size_t   size;
+   uint64_t         serial;  /* Age, among the entries of all the editors */
+   size_t           bytes;   /* Memory held, as accounted */
+   Eina_Bool        redo;    /* In the redo stack */
+   unsigned int     count;   /* Records */
+   Snapshot_Record *records; /* Raw records, until they are compressed */
+   const Codec     *codec;   /* Of the compressed records */
+   uint8_t         *mem;     /* Compressed records */
+   size_t           size;
+   Snapshot_Job    *job;
 } Snapshot;
 
-static Snapshot *
-snapshot_new(uint8_t *buf,
-             size_t   size)
+/*
+ * Compression of the records of an entry. The job outlives its entry
+ * if this one is freed meanwhile (shot is then NULL).
+ */
+struct _Snapshot_Job
 {
-   Snapshot *shot;
+   Editor                *ed;
+   Snapshot              *shot;
+   Ecore_Thread          *thread;
+   const Codec           *codec;
+   const Snapshot_Record *records;
+   unsigned int           count;
+   size_t                 raw_size;
+   uint8_t               *out;
+   size_t                 out_size;
+};
 
-   shot = malloc(sizeof(*shot) + size);
-   if (EINA_UNLIKELY(!shot))
+static size_t _bytes = 0; /* Held by all the histories */
+static size_t _budget = 0;
+static uint64_t _serial = 0;
+static Eina_List *_histories = NULL; /* Editors */
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static size_t
+_snapshot_budget_get(const char *var,
+                     long        mib)
+{
+   const char *env;
+   long val;
+
+   /* Budget can be tuned, in MiB */
+   env = getenv(var);
+   if (env)
      {
-        CRI("Failed to allocate memory");
-        return NULL;
+        val = strtol(env, NULL, 10);
+        if (val <= 0)
+          WRN("Invalid undo budget \"%s\". Using %li MiB", env, mib);
+        else
+          mib = val;
      }
 
-   shot->mem = (uint8_t *)shot + sizeof(*shot);
-   memcpy(shot->mem, buf, size);
-   shot->size = size;
-   return shot;
+   return (size_t)mib * 1024 * 1024;
+}
+
+/* What an entry actually holds: the records are dropped once compressed */
+static size_t
+_snapshot_bytes_get(const Snapshot *shot)
+{
+   size_t bytes = sizeof(*shot) + shot->size;
+
+   if (shot->records)
+     bytes += shot->count * sizeof(Snapshot_Record);
+   if (shot->job)
+     bytes += sizeof(Snapshot_Job);
+   return bytes;
+}
+
+static void
+_bytes_add(Editor   *ed,
+           Snapshot *shot)
+{
+   shot->bytes = _snapshot_bytes_get(shot);
+   ed->snapshot.bytes[shot->redo] += shot->bytes;
+   _bytes += shot->bytes;
+   stats_add(STATS_UNDO_BYTES, shot->bytes);
+}
+
+static void
+_bytes_del(Editor   *ed,
+           Snapshot *shot)
+{
+   ed->snapshot.bytes[shot->redo] -= shot->bytes;
+   _bytes -= shot->bytes;
+   stats_add(STATS_UNDO_BYTES, -(uint64_t)shot->bytes);
+   shot->bytes = 0;
 }
 
 static void
 snapshot_free(Snapshot *shot)
 {
+   if (shot->job)
+     {
+        /* The job will release the records itself */
+        shot->job->shot = NULL;
+        shot->job->ed = NULL;
+        ecore_thread_cancel(shot->job->thread);
+     }
+   else
+     free(shot->records);
+   free(shot->mem);
    free(shot);
 }
 
-static Eina_Bool
-_snapshot_delayed_cb(void *data)
+static void
+_snapshot_list_free(Editor       *ed,
+                    Eina_Inlist **list)
 {
-   Editor *const ed = data;
    Snapshot *shot;
 
-   DBG("Doing snapshot");
-   snapshot_force_push(ed);
-   if (ed->snapshot.redos)
+   EINA_INLIST_FREE(*list, shot)
      {
-        INF("Purging old redos");
-        EINA_INLIST_FREE(ed->snapshot.redos, shot)
+        *list = eina_inlist_remove(*list, EINA_INLIST_GET(shot));
+        _bytes_del(ed, shot);
+        snapshot_free(shot);
+     }
+}
+
+static void
+_snapshot_evict(Editor   *ed,
+                Snapshot *shot)
+{
+   ed->snapshot.items = eina_inlist_remove(ed->snapshot.items,
+                                           EINA_INLIST_GET(shot));
+   _bytes_del(ed, shot);
+   snapshot_free(shot);
+   stats_add(STATS_UNDO_EVICTIONS, 1);
+}
+
+/*
+ * Oldest entries are evicted while the budgets are exceeded: the one of
+ * the editor first, then the global one (any editor). The entry that has
+ * just been pushed is never evicted, so the last edit can be undone.
+ */
+static void
+_budgets_enforce(Editor   *ed,
+                 Snapshot *keep)
+{
+   Eina_List *l;
+   Editor *e, *victim;
+   Snapshot *shot, *oldest;
+   unsigned int evicted = 0;
+
+   while (ed->snapshot.bytes[0] + ed->snapshot.bytes[1] > ed->snapshot.budget)
+     {
+        shot = EINA_INLIST_CONTAINER_GET(ed->snapshot.items, Snapshot);
+        if ((!shot) || (shot == keep)) break;
+        _snapshot_evict(ed, shot);
+        evicted++;
+     }
+
+   while (_bytes > _budget)
+     {
+        oldest = NULL;
+        victim = NULL;
+        EINA_LIST_FOREACH(_histories, l, e)
           {
-             ed->snapshot.redos = eina_inlist_remove(ed->snapshot.redos,
-                                                     EINA_INLIST_GET(shot));
-             snapshot_free(shot);
+             shot = EINA_INLIST_CONTAINER_GET(e->snapshot.items, Snapshot);
+             if ((!shot) || (shot == keep)) continue;
+             if ((!oldest) || (shot->serial < oldest->serial))
+               {
+                  oldest = shot;
+                  victim = e;
+               }
           }
+        if (!oldest) break;
+        _snapshot_evict(victim, oldest);
+        evicted++;
      }
-   ed->snapshot.requests = 0;
-
-   // TODO ENABLE undo menu
 
-   return ECORE_CALLBACK_CANCEL;
+   if (evicted)
+     INF("Undo history: %u entries evicted. Editor holds %zu bytes "
+         "(budget %zu), all editors %zu bytes (budget %zu)",
+         evicted, ed->snapshot.bytes[0] + ed->snapshot.bytes[1],
+         ed->snapshot.budget, _bytes, _budget);
 }
 
-Eina_Bool
-snapshot_force_push(Editor *ed)
+static Eina_Bool
+_buffer_reserve(Editor *ed,
+                size_t  size)
 {
-   lzma_stream stream = LZMA_STREAM_INIT;
-   lzma_ret ret;
-   size_t size = 0;
+   uint8_t *buf;
 
-   ret = lzma_easy_encoder(&stream, 1, LZMA_CHECK_CRC64);
-   if (EINA_UNLIKELY(ret != LZMA_OK))
+   if (size <= ed->snapshot.buf_len)
+     return EINA_TRUE;
+
+   buf = realloc(ed->snapshot.buffer, size);
+   if (EINA_UNLIKELY(!buf))
      {
-        CRI("Failed to initialize LZMA stream");
+        CRI("Failed to allocate memory");
         return EINA_FALSE;
      }
+   ed->snapshot.buffer = buf;
+   ed->snapshot.buf_len = size;
+   return EINA_TRUE;
+}
 
-   /*
-    * FIXME use dynamic buffer to avoid overflowing
-    */
-   stream.next_in = (const uint8_t *)(ed->cells[0]);
-   stream.avail_in = sizeof(Cell) * ed->pud->map_w * ed->pud->map_h;
-   stream.next_out = ed->snapshot.buffer;
-   stream.avail_out = ed->snapshot.buf_len;
+/*
+ * Records are given to the codecs field by field: all the cells before,
+ * all the cells after, then their indexes. Similar values are then next
+ * to each other (e.g. the cells painted by a brush).
+ */
+#define SNAPSHOT_PLANES_SIZE(count_) \
+   ((size_t)(count_) * (2 * sizeof(Cell) + sizeof(uint32_t)))
+
+static void
+_records_split(const Snapshot_Record *records,
+               unsigned int           count,
+               uint8_t               *planes)
+{
+   Cell *const before = (Cell *)planes;
+   Cell *const after = before + count;
+   uint32_t *const cells = (uint32_t *)(after + count);
+   unsigned int k;
 
-   ret = lzma_code(&stream, LZMA_RUN);
-   if (stream.avail_out == 0)
+   for (k = 0; k < count; k++)
      {
-        CRI("No more memory available for compression");
-        goto fail;
+        before[k] = records[k].before;
+        after[k] = records[k].after;
+        cells[k] = records[k].cell;
      }
-   else if (ret == LZMA_OK)
+}
+
+static void
+_records_join(const uint8_t   *planes,
+              unsigned int     count,
+              Snapshot_Record *records)
+{
+   const Cell *const before = (const Cell *)planes;
+   const Cell *const after = before + count;
+   const uint32_t *const cells = (const uint32_t *)(after + count);
+   unsigned int k;
+
+   for (k = 0; k < count; k++)
      {
-        /* Done, say to lzma we are finished */
-        ret = lzma_code(&stream, LZMA_FINISH);
-        if ((ret == LZMA_OK) || (ret == LZMA_STREAM_END))
-          {
-             size = ed->snapshot.buf_len - stream.avail_out;
-             INF("Created compressed image with size %zu bytes", size);
-          }
-        else
-          {
-             CRI("Something went wrong: 0x%x", ret);
-             goto fail;
-          }
+        records[k].before = before[k];
+        records[k].after = after[k];
+        records[k].cell = cells[k];
+     }
+}
+
+static Eina_Bool
+_records_encode(const Codec            *codec,
+                const Snapshot_Record  *records,
+                unsigned int            count,
+                uint8_t               **out,
+                size_t                 *out_size)
+{
+   const size_t size = SNAPSHOT_PLANES_SIZE(count);
+   uint8_t *planes;
+   Eina_Bool ok;
+
+   planes = malloc(size);
+   if (EINA_UNLIKELY(!planes))
+     return EINA_FALSE;
+   _records_split(records, count, planes);
+   ok = codec->encode(planes, size, sizeof(Cell), out, out_size);
+   free(planes);
+   return ok;
+}
+
+static Eina_Bool
+_records_decode(const Codec     *codec,
+                const uint8_t   *in,
+                size_t           size,
+                unsigned int     count,
+                Snapshot_Record *records)
+{
+   const size_t planes_size = SNAPSHOT_PLANES_SIZE(count);
+   uint8_t *planes;
+   Eina_Bool ok;
+
+   planes = malloc(planes_size);
+   if (EINA_UNLIKELY(!planes))
+     return EINA_FALSE;
+   ok = codec->decode(in, size, sizeof(Cell), planes, planes_size);
+   if (ok)
+     _records_join(planes, count, records);
+   free(planes);
+   return ok;
+}
+
+static void
+_records_encode_cb(void         *data,
+                   Ecore_Thread *thread EINA_UNUSED)
+{
+   Snapshot_Job *const job = data;
+
+   /* No editor data is touched here: the records belong to the entry */
+   if (!_records_encode(job->codec, job->records, job->count,
+                        &(job->out), &(job->out_size)))
+     job->out = NULL;
+}
+
+static void
+_records_encode_end_cb(void         *data,
+                       Ecore_Thread *thread EINA_UNUSED)
+{
+   Snapshot_Job *const job = data;
+   Snapshot *const shot = job->shot;
+   uint8_t *mem;
+
+   if (!shot)
+     {
+        /* Entry is gone. Drop everything */
+        free(job->out);
+        free((Snapshot_Record *)job->records);
+     }
+   else if (!job->out)
+     {
+        /* Keep it uncompressed. It still does the job. */
+        WRN("Failed to compress snapshot. It is kept raw.");
+        _bytes_del(job->ed, shot);
+        shot->job = NULL;
+        _bytes_add(job->ed, shot);
      }
    else
      {
-        CRI("Something went wrong: 0x%x", ret);
-        goto fail;
+        _bytes_del(job->ed, shot);
+        mem = realloc(job->out, job->out_size);
+        shot->mem = (mem) ? mem : job->out;
+        shot->size = job->out_size;
+        shot->codec = job->codec;
+        free(shot->records);
+        shot->records = NULL;
+        shot->job = NULL;
+        _bytes_add(job->ed, shot);
+        DBG("Compressed snapshot (%s): %zu bytes, from %zu",
+            shot->codec->name, shot->size, job->raw_size);
      }
-   lzma_end(&stream);
+   free(job);
+}
 
-   /* There is a snapshot */
-   if (size != 0)
+static void
+_records_encode_cancel_cb(void         *data,
+                          Ecore_Thread *thread EINA_UNUSED)
+{
+   Snapshot_Job *const job = data;
+   Snapshot *const shot = job->shot;
+
+   /* Whatever the worker produced is dropped: the raw records remain */
+   free(job->out);
+   if (shot)
      {
-        Snapshot *shot;
-        unsigned int count;
+        _bytes_del(job->ed, shot);
+        shot->job = NULL;
+        _bytes_add(job->ed, shot);
+     }
+   else
+     free((Snapshot_Record *)job->records);
+   free(job);
+}
+
+/*
+ * Large entries (e.g. generated maps) are compressed in a worker thread,
+ * and attached when it is done. Until then, the raw records are used.
+ */
+static void
+_records_compress(Editor   *ed,
+                  Snapshot *shot)
+{
+   Snapshot_Job *job;
+   Ecore_Thread *thread;
+
+   job = calloc(1, sizeof(*job));
+   if (EINA_UNLIKELY(!job))
+     {
+        CRI("Failed to allocate memory");
+        return;
+     }
+   job->ed = ed;
+   job->shot = shot;
+   job->codec = ed->snapshot.codec;
+   job->records = shot->records;
+   job->count = shot->count;
+   job->raw_size = SNAPSHOT_PLANES_SIZE(shot->count);
+   _bytes_del(ed, shot);
+   shot->job = job;
+   _bytes_add(ed, shot);
+
+   /* If no thread is available, the job may be done right away */
+   thread = ecore_thread_run(_records_encode_cb, _records_encode_end_cb,
+                             _records_encode_cancel_cb, job);
+   if (shot->job)
+     shot->job->thread = thread;
+}
+
+static const Snapshot_Record *
+_records_get(Editor         *ed,
+             const Snapshot *shot)
+{
+   const size_t size = shot->count * sizeof(Snapshot_Record);
+
+   /* Not compressed (yet) */
+   if (shot->records)
+     return shot->records;
+
+   if (EINA_UNLIKELY(!_buffer_reserve(ed, size)))
+     return NULL;
+   if (!_records_decode(shot->codec, shot->mem, shot->size, shot->count,
+                        (Snapshot_Record *)ed->snapshot.buffer))
+     {
+        CRI("Failed to decode snapshot (%s)", shot->codec->name);
+        return NULL;
+     }
+   return (const Snapshot_Record *)ed->snapshot.buffer;
+}
+
+static inline Eina_Bool
+_units_differ(const Cell *a,
+              const Cell *b)
+{
+   return ((a->unit_below != b->unit_below) ||
+           (a->unit_above != b->unit_above) ||
+           (a->anchor_below != b->anchor_below) ||
+           (a->anchor_above != b->anchor_above) ||
+           (a->player_below != b->player_below) ||
+           (a->player_above != b->player_above) ||
+           (a->start_location != b->start_location) ||
+           (a->start_location_human != b->start_location_human));
+}
+
+/* Cells required to draw the units anchored at (x, y) */
+static void
+_units_zone_add(const Editor   *ed,
+                unsigned int    x,
+                unsigned int    y,
+                Eina_Rectangle *zone)
+{
+   const Cell *const c = &(ed->cells[y][x]);
+   Eina_Rectangle bbox;
+
+   if (c->anchor_below &&
+       unitindex_bbox_get(ed, x, y, UNIT_BELOW, &bbox))
+     eina_rectangle_union(zone, &bbox);
+   if (c->anchor_above &&
+       unitindex_bbox_get(ed, x, y, UNIT_ABOVE, &bbox))
+     eina_rectangle_union(zone, &bbox);
+   if ((c->start_location != CELL_NOT_START_LOCATION) &&
+       unitindex_bbox_get(ed, x, y, UNIT_START_LOCATION, &bbox))
+     eina_rectangle_union(zone, &bbox);
+}
+
+/*
+ * Restores the cells of an entry, as they were before it (undo) or after
+ * it (redo). Only the cells it changed are refreshed.
+ */
+static void
+_records_apply(Editor                *ed,
+               const Snapshot_Record *records,
+               unsigned int           count,
+               Eina_Bool              undo)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const Cell *from, *to;
+   Eina_Rectangle zone, cell, map;
+   Eina_Bool units = EINA_FALSE;
+   unsigned int k, x, y;
+
+   EINA_RECTANGLE_SET(&zone, records[0].cell % map_w,
+                      records[0].cell / map_w, 1, 1);
 
-        shot = snapshot_new(ed->snapshot.buffer, size);
-        if (EINA_UNLIKELY(!shot))
+   for (k = 0; k < count; k++)
+     {
+        x = records[k].cell % map_w;
+        y = records[k].cell / map_w;
+        from = (undo) ? &(records[k].after) : &(records[k].before);
+        to = (undo) ? &(records[k].before) : &(records[k].after);
+
+        EINA_RECTANGLE_SET(&cell, x, y, 1, 1);
+        eina_rectangle_union(&zone, &cell);
+        if (_units_differ(from, to))
           {
-             CRI("Failed to create snapshot");
-             return EINA_FALSE;
+             /* Sprites going away */
+             _units_zone_add(ed, x, y, &zone);
+             units = EINA_TRUE;
+             if (from->start_location != CELL_NOT_START_LOCATION)
+               {
+                  ed->start_locations[from->start_location].x = -1;
+                  ed->start_locations[from->start_location].y = -1;
+               }
           }
+        ed->cells[y][x] = *to;
+        editor_maps_dirty_set(ed, x, y);
+     }
 
-        count = eina_inlist_count(ed->snapshot.items);
-        if (count >= SNAPSHOT_MAX)
+   if (units)
+     {
+        unitindex_rebuild(ed);
+        editor_units_recount(ed);
+        editor_units_list_update(ed);
+        for (k = 0; k < count; k++)
           {
-             Eina_Inlist *l;
+             to = (undo) ? &(records[k].before) : &(records[k].after);
+             x = records[k].cell % map_w;
+             y = records[k].cell / map_w;
+             if (to->start_location != CELL_NOT_START_LOCATION)
+               {
+                  ed->start_locations[to->start_location].x = x;
+                  ed->start_locations[to->start_location].y = y;
+               }
+             /* Sprites coming back */
+             _units_zone_add(ed, x, y, &zone);
+          }
+     }
+
+   EINA_RECTANGLE_SET(&map, 0, 0, map_w, ed->pud->map_h);
+   eina_rectangle_intersection(&zone, &map);
+
+   /* Minimap pixels of units span several cells: redo them in order */
+   for (y = zone.y; y < (unsigned int)(zone.y + zone.h); y++)
+     for (x = zone.x; x < (unsigned int)(zone.x + zone.w); x++)
+       minimap_update(ed, x, y);
+   minimap_render(ed, zone.x, zone.y, zone.w, zone.h);
+   bitmap_refresh(ed, &zone);
+
+   DBG("Applied %u records (%s) in %ix%i+%i+%i", count,
+       (undo) ? "undo" : "redo", zone.w, zone.h, zone.x, zone.y);
+}
+
+static void
+_journal_reset(Editor *ed)
+{
+   free(ed->snapshot.journal);
+   free(ed->snapshot.touched);
+   ed->snapshot.journal = NULL;
+   ed->snapshot.journal_count = 0;
+   ed->snapshot.journal_size = 0;
+   ed->snapshot.touched = NULL;
+   ed->snapshot.cells = 0;
+}
+
+static void
+_snapshot_reset(Editor *ed)
+{
+   _snapshot_list_free(ed, &(ed->snapshot.items));
+   _snapshot_list_free(ed, &(ed->snapshot.redos));
+   _journal_reset(ed);
+}
+
+static Eina_Bool
+_snapshot_delayed_cb(void *data)
+{
+   Editor *const ed = data;
+
+   DBG("Doing snapshot");
+   ed->snapshot.timer = NULL;
+   snapshot_force_push(ed);
 
-             DBG("Too many snapshot snapshots. Removing the oldest.");
-             l = eina_inlist_first(ed->snapshot.items);
-             // XXX???       snapshot_free(EINA_INLIST_CONTAINER_GET(l, Snapshot));
-             ed->snapshot.items = eina_inlist_remove(ed->snapshot.items, l);
+   // TODO ENABLE undo menu
+
+   return ECORE_CALLBACK_CANCEL;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+void
+snapshot_cell_touch(Editor       *ed,
+                    unsigned int  x,
+                    unsigned int  y)
+{
+   const unsigned int cells = ed->pud->map_w * ed->pud->map_h;
+   const unsigned int k = (y * ed->pud->map_w) + x;
+   Snapshot_Record *rec;
+   unsigned int size;
+
+   /* Changes made outside of transactions are not undoable */
+   if (ed->snapshot.depth == 0)
+     return;
+   if (EINA_UNLIKELY((x >= ed->pud->map_w) || (y >= ed->pud->map_h)))
+     return;
+
+   /* The map has been resized: history starts over */
+   if (ed->snapshot.cells != cells)
+     {
+        _snapshot_reset(ed);
+        ed->snapshot.touched = calloc((cells + 31) / 32, sizeof(uint32_t));
+        if (EINA_UNLIKELY(!ed->snapshot.touched))
+          {
+             CRI("Failed to allocate memory");
+             return;
           }
-        ed->snapshot.items = eina_inlist_append(ed->snapshot.items, EINA_INLIST_GET(shot));
+        ed->snapshot.cells = cells;
+     }
+
+   /* Only the first state of a cell matters */
+   if (ed->snapshot.touched[k / 32] & (1u << (k % 32)))
+     return;
 
-        DBG("snapshot count is now %u. New: %p",
-            eina_inlist_count(ed->snapshot.items), shot);
+   if (ed->snapshot.journal_count == ed->snapshot.journal_size)
+     {
+        size = (ed->snapshot.journal_size) ? ed->snapshot.journal_size * 2 : 64;
+        rec = realloc(ed->snapshot.journal, size * sizeof(*rec));
+        if (EINA_UNLIKELY(!rec))
+          {
+             CRI("Failed to allocate memory");
+             return;
+          }
+        ed->snapshot.journal = rec;
+        ed->snapshot.journal_size = size;
      }
 
-   return EINA_TRUE;
+   ed->snapshot.touched[k / 32] |= (1u << (k % 32));
+   rec = &(ed->snapshot.journal[ed->snapshot.journal_count++]);
+   rec->cell = k;
+   rec->before = ed->cells[y][x];
+}
 
-fail:
-   lzma_end(&stream);
-   return EINA_FALSE;
+Eina_Bool
+snapshot_force_push(Editor *ed)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   Snapshot_Record *rec;
+   Snapshot *shot;
+   unsigned int k, count = 0;
+
+   if (ed->snapshot.timer)
+     {
+        ecore_timer_del(ed->snapshot.timer);
+        ed->snapshot.timer = NULL;
+     }
+   if (ed->snapshot.journal_count == 0)
+     return EINA_TRUE;
+
+   /* Cells that ended like they started are not recorded */
+   for (k = 0; k < ed->snapshot.journal_count; k++)
+     {
+        rec = &(ed->snapshot.journal[k]);
+        ed->snapshot.touched[rec->cell / 32] &= ~(1u << (rec->cell % 32));
+        rec->after = ed->cells[rec->cell / map_w][rec->cell % map_w];
+        if (memcmp(&(rec->before), &(rec->after), sizeof(Cell)))
+          ed->snapshot.journal[count++] = *rec;
+     }
+   ed->snapshot.journal_count = 0;
+   if (count == 0)
+     {
+        DBG("Nothing changed since the last snapshot");
+        return EINA_TRUE;
+     }
+
+   shot = calloc(1, sizeof(*shot));
+   if (EINA_UNLIKELY(!shot))
+     {
+        CRI("Failed to allocate memory");
+        return EINA_FALSE;
+     }
+
+   /* The entry takes the journal over */
+   rec = realloc(ed->snapshot.journal, count * sizeof(*rec));
+   shot->records = (rec) ? rec : ed->snapshot.journal;
+   shot->count = count;
+   ed->snapshot.journal = NULL;
+   ed->snapshot.journal_size = 0;
+
+   shot->serial = _serial++;
+
+   /* A new state invalidates what has been undone */
+   if (ed->snapshot.redos)
+     {
+        INF("Purging old redos");
+        _snapshot_list_free(ed, &(ed->snapshot.redos));
+     }
+
+   ed->snapshot.items = eina_inlist_append(ed->snapshot.items,
+                                           EINA_INLIST_GET(shot));
+   _bytes_add(ed, shot);
+   if (count * sizeof(Snapshot_Record) >= SNAPSHOT_COMPRESS_MIN)
+     _records_compress(ed, shot);
+   _budgets_enforce(ed, shot);
+
+   DBG("snapshot count is now %u. New: %u cells. Undo history holds "
+       "%zu bytes, %zu for all editors",
+       eina_inlist_count(ed->snapshot.items), count,
+       ed->snapshot.bytes[0], _bytes);
+
+   return EINA_TRUE;
 }
 
 Eina_Bool
 snapshot_add(Editor *ed)
 {
    ed->snapshot.items = NULL;
-
-   /* FIXME meh */
-   ed->snapshot.buf_len = (1 << 14); /* 16KiB */
-   ed->snapshot.buffer = malloc(ed->snapshot.buf_len);
+   ed->snapshot.redos = NULL;
+   ed->snapshot.journal = NULL;
+   ed->snapshot.journal_count = 0;
+   ed->snapshot.journal_size = 0;
+   ed->snapshot.touched = NULL;
+   ed->snapshot.cells = 0;
+   ed->snapshot.depth = 0;
+   ed->snapshot.timer = NULL;
+   ed->snapshot.buf_len = 0;
+   ed->snapshot.buffer = NULL;
+   ed->snapshot.bytes[0] = 0;
+   ed->snapshot.bytes[1] = 0;
+   ed->snapshot.codec = codec_default_get();
+   ed->snapshot.budget = _snapshot_budget_get("WAR2EDIT_UNDO_BUDGET",
+                                              SNAPSHOT_BUDGET_DEFAULT);
+   if (!_budget)
+     _budget = _snapshot_budget_get("WAR2EDIT_UNDO_BUDGET_TOTAL",
+                                    SNAPSHOT_BUDGET_TOTAL_DEFAULT);
+   _histories = eina_list_append(_histories, ed);
 
    // TODO Set UNDO menu to DISABLED
 
-   /* Create the initial snapshot */
-   return snapshot_force_push(ed);
+   return EINA_TRUE;
 }
 
 void
 snapshot_del(Editor *ed)
 {
-   Snapshot *shot;
-
+   snapshot_clear(ed);
    free(ed->snapshot.buffer);
-   EINA_INLIST_FREE(ed->snapshot.items, shot)
+   _histories = eina_list_remove(_histories, ed);
+}
+
+void
+snapshot_clear(Editor *ed)
+{
+   if (ed->snapshot.timer)
      {
-        ed->snapshot.items = eina_inlist_remove(ed->snapshot.items, EINA_INLIST_GET(shot));
-        snapshot_free(shot);
+        ecore_timer_del(ed->snapshot.timer);
+        ed->snapshot.timer = NULL;
      }
+   _snapshot_reset(ed);
 }
 
 void
-snapshot_push(Editor *ed EINA_UNUSED)
+snapshot_push(Editor *ed)
 {
-   /* Nothing to do */
+   /* Opens a transaction. Cells touched from now on are recorded. */
+   ed->snapshot.depth++;
 }
 
 void
 snapshot_push_done(Editor *ed)
 {
+   EINA_SAFETY_ON_TRUE_RETURN(ed->snapshot.depth == 0);
+
+   if (--ed->snapshot.depth > 0)
+     return;
+
    /*
-    * I have the feeling one day there will be synchro plroblem...
-    * And this function might help
+    * Transactions that follow each other closely (e.g. a brush stroke)
+    * make a single entry. It is sealed when they stop.
     */
-   if (++ed->snapshot.requests == 1)
+   if (ed->snapshot.journal_count > 0)
      {
-        ecore_timer_add(1.0, _snapshot_delayed_cb, ed);
+        if (ed->snapshot.timer)
+          ecore_timer_reset(ed->snapshot.timer);
+        else
+          ed->snapshot.timer = ecore_timer_add(SNAPSHOT_DELAY,
+                                               _snapshot_delayed_cb, ed);
+        DBG("Trigerring snapshot");
      }
-   DBG("Trigerring snapshot");
 }
 
 Eina_Bool
 snapshot_rollback(Editor *ed,
                   int offset)
 {
-   unsigned int count;
-   int i;
-   int magic;
-   Eina_Inlist **ptr;
-   Eina_Inlist *l;
+   const Snapshot_Record *records;
+   Eina_Inlist **from, **to, *l;
    Snapshot *shot;
-   lzma_stream stream = LZMA_STREAM_INIT;
-   lzma_ret ret;
-   Eina_Bool redo;
+   int i;
 
    /*
     * Offset > 0 is used to go back to the future :)
@@ -240,97 +827,337 @@ snapshot_rollback(Editor *ed,
     *
     * If we rollback ZERO versions, we don't have to do anything
     */
-   if (offset > 0)
-     {
-        ptr = &(ed->snapshot.redos);
-        redo = EINA_TRUE;
-        magic = 0;
-     }
-   else if (offset < 0)
-     {
-        ptr = &(ed->snapshot.items);
-        redo = EINA_FALSE;
-        magic = 1;
-     }
-   else
+   if (offset == 0)
      return EINA_TRUE;
 
-   /* Cannot snapshot when the list is empty */
-   count = eina_inlist_count(*ptr);
-   DBG("Elements in stack: %u", count);
-   if (count <= (unsigned int)magic)
+   /* Edits still waiting for their entry are the first to be undone */
+   snapshot_force_push(ed);
+
+   /* The map has been resized since: there is nothing to go back to */
+   if ((ed->snapshot.cells != 0) &&
+       (ed->snapshot.cells != ed->pud->map_w * ed->pud->map_h))
      {
-        INF("No elements in stack. Cannot rollback");
+        INF("Map has been resized. Resetting history.");
+        snapshot_clear(ed);
         return EINA_FALSE;
      }
-   DBG("Snapshots stack with %u elements", count);
-   DBG("Offset is %i, abs() -> %i", offset, abs(offset));
 
-   l = eina_inlist_last(*ptr);
+   from = (offset > 0) ? &(ed->snapshot.redos) : &(ed->snapshot.items);
+   to = (offset > 0) ? &(ed->snapshot.items) : &(ed->snapshot.redos);
 
-   /* Pop compressed blob */
    for (i = 0; i < abs(offset); i++)
      {
-        if (count > 1)
-          {
-             *ptr = eina_inlist_remove(*ptr, l);
-          }
-
-        if (!redo)
+        if (!*from)
           {
-             ed->snapshot.redos = eina_inlist_append(ed->snapshot.redos, l);
-             WRN("Pushing snapshot in redo stack (list %p, shot %p). count is now %u",
-                 l, EINA_INLIST_CONTAINER_GET(l, Snapshot),eina_inlist_count(ed->snapshot.redos));
+             INF("No elements in stack. Cannot rollback");
+             break;
           }
+        l = (*from)->last;
+        shot = EINA_INLIST_CONTAINER_GET(l, Snapshot);
+        records = _records_get(ed, shot);
+        if (EINA_UNLIKELY(!records))
+          break;
 
-        DBG("Deleting element N-%i", i);
-        l = eina_inlist_last(*ptr);
-        count--;
+        _records_apply(ed, records, shot->count, (offset < 0));
+        *from = eina_inlist_remove(*from, l);
+        *to = eina_inlist_append(*to, l);
+        _bytes_del(ed, shot);
+        shot->redo = (offset < 0);
+        _bytes_add(ed, shot);
      }
+   if (i == 0)
+     return EINA_FALSE;
+
+   DBG("Rolled back %i snapshots", i);
+   editor_changed(ed);
+
+   return EINA_TRUE;
+}
 
-   if (count == (unsigned int)magic)
+void
+snapshot_bytes_get(const Editor *ed,
+                   size_t       *undo,
+                   size_t       *redo)
+{
+   if (undo) *undo = ed->snapshot.bytes[0];
+   if (redo) *redo = ed->snapshot.bytes[1];
+}
+
+size_t
+snapshot_bytes_total_get(void)
+{
+   return _bytes;
+}
+
+/*
+ * Edit patterns of the benchmark, recorded as the journal does. They are
+ * synthetic (no journal of a real session is replayed): they only mimic
+ * the shape of common edits. The map starts as plain grass.
+ */
+typedef enum
+{
+   SNAPSHOT_BENCH_STROKE,    /* Brush dragged around */
+   SNAPSHOT_BENCH_UNITS,     /* Units dropped here and there */
+   SNAPSHOT_BENCH_FILL,      /* A quarter of the map filled */
+   SNAPSHOT_BENCH_GENERATOR, /* Every cell, at random */
+   __SNAPSHOT_BENCH_LAST
+} Snapshot_Bench;
+
+static const char *const _bench_names[__SNAPSHOT_BENCH_LAST] =
+{
+   [SNAPSHOT_BENCH_STROKE]    = "stroke",
+   [SNAPSHOT_BENCH_UNITS]     = "units",
+   [SNAPSHOT_BENCH_FILL]      = "fill",
+   [SNAPSHOT_BENCH_GENERATOR] = "generator",
+};
+
+static void
+_bench_touch(Cell            *cells,
+             unsigned int     k,
+             uint8_t         *touched,
+             Snapshot_Record *records,
+             unsigned int    *count)
+{
+   if (touched[k]) return;
+   touched[k] = 1;
+   records[*count].cell = k;
+   records[*count].before = cells[k];
+   (*count)++;
+}
+
+static void
+_bench_tile_set(Cell    *c,
+                uint8_t  tl,
+                uint8_t  tr,
+                uint8_t  bl,
+                uint8_t  br,
+                uint16_t tile)
+{
+   c->tile_tl = tl;
+   c->tile_tr = tr;
+   c->tile_bl = bl;
+   c->tile_br = br;
+   c->tile = tile;
+}
+
+static unsigned int
+_bench_record(Snapshot_Bench   bench,
+              Cell            *cells,
+              unsigned int     w,
+              unsigned int     h,
+              Prng            *prng,
+              Snapshot_Record *records)
+{
+   uint8_t *touched;
+   unsigned int i, j, n, k, x, y, count = 0, kept = 0;
+
+   touched = calloc(w * h, sizeof(uint8_t));
+   if (EINA_UNLIKELY(!touched))
+     return 0;
+
+   switch (bench)
      {
-        // TODO Set menu undo to DISABLED
-     }
+      case SNAPSHOT_BENCH_STROKE:
+         x = w / 2;
+         y = h / 2;
+         for (n = 0; n < 48; n++)
+           {
+              for (j = y - 1; j <= y + 1; j++)
+                for (i = x - 1; i <= x + 1; i++)
+                  {
+                     k = (j * w) + i;
+                     _bench_touch(cells, k, touched, records, &count);
+                     _bench_tile_set(&(cells[k]), TILE_TREES, TILE_TREES,
+                                     TILE_TREES, TILE_TREES,
+                                     0x0070 | prng_below(prng, 3));
+                  }
+              x = MIN(MAX(x + prng_below(prng, 3) - 1, 1), w - 2);
+              y = MIN(MAX(y + prng_below(prng, 3) - 1, 1), h - 2);
+           }
+         break;
+
+      case SNAPSHOT_BENCH_UNITS:
+         for (n = 0; n < 24; n++)
+           {
+              x = prng_below(prng, w - 1);
+              y = prng_below(prng, h - 1);
+              for (j = 0; j < 2; j++)
+                for (i = 0; i < 2; i++)
+                  {
+                     k = ((y + j) * w) + (x + i);
+                     _bench_touch(cells, k, touched, records, &count);
+                     cells[k].unit_below = PUD_UNIT_FARM;
+                     cells[k].player_below = n % 8;
+                     cells[k].spread_x_below = i;
+                     cells[k].spread_y_below = j;
+                     cells[k].anchor_below = 0;
+                  }
+              k = (y * w) + x;
+              cells[k].anchor_below = 1;
+              cells[k].spread_x_below = 2;
+              cells[k].spread_y_below = 2;
+           }
+         break;
 
-   shot = EINA_INLIST_CONTAINER_GET(l, Snapshot);
-   *ptr = eina_inlist_remove(*ptr, l);
-   DBG("Using snapshot %p from list %p. There is now %u elements", shot, l, count);
+      case SNAPSHOT_BENCH_FILL:
+         for (j = h / 4; j < 3 * h / 4; j++)
+           for (i = w / 4; i < 3 * w / 4; i++)
+             {
+                k = (j * w) + i;
+                _bench_touch(cells, k, touched, records, &count);
+                _bench_tile_set(&(cells[k]), TILE_WATER_LIGHT, TILE_WATER_LIGHT,
+                                TILE_WATER_LIGHT, TILE_WATER_LIGHT, 0x0010);
+             }
+         break;
 
-   ret = lzma_stream_decoder(&stream, UINT32_MAX, LZMA_CONCATENATED);
-   if (ret != LZMA_OK)
+      case SNAPSHOT_BENCH_GENERATOR:
+         for (k = 0; k < w * h; k++)
+           {
+              _bench_touch(cells, k, touched, records, &count);
+              _bench_tile_set(&(cells[k]), prng_below(prng, 8),
+                              prng_below(prng, 8), prng_below(prng, 8),
+                              prng_below(prng, 8), prng_below(prng, 0x0a00));
+           }
+         break;
+
+      default:
+         break;
+     }
+
+   /* Sealed as an entry would be */
+   for (n = 0; n < count; n++)
      {
-        CRI("Failed to create LZMA decoder");
-        return EINA_FALSE;
+        records[n].after = cells[records[n].cell];
+        if (memcmp(&(records[n].before), &(records[n].after), sizeof(Cell)))
+          records[kept++] = records[n];
      }
+   free(touched);
+   return kept;
+}
 
-   stream.avail_in = shot->size;
-   stream.next_in = shot->mem;
-   stream.avail_out = ed->pud->map_w * ed->pud->map_h * sizeof(Cell);
-   stream.next_out = (uint8_t *)(ed->cells[0]);
+Eina_Bool
+snapshot_benchmark(void)
+{
+   const unsigned int sizes[] = { 32, 64, 96, 128 };
+   const unsigned int loops = 8;
+   Snapshot_Record *records = NULL, *decoded = NULL;
+   Cell *initial = NULL, *cells = NULL;
+   const Codec *codec;
+   Snapshot_Bench bench;
+   unsigned int s, c, l, k, count, w, h, errors = 0;
+   uint8_t *out;
+   size_t out_size;
+   double start, t_push, t_rollback;
+   Prng prng;
 
-   ret = lzma_code(&stream, LZMA_RUN);
-   if (ret == LZMA_OK)
+   printf("snapshot: %-9s %-10s %7s %6s %9s %7s %10s %10s\n",
+          "edit", "codec", "map", "cells", "bytes", "ratio",
+          "push ms", "undo ms");
+
+   for (s = 0; s < EINA_C_ARRAY_LENGTH(sizes); s++)
      {
-        ret = lzma_code(&stream, LZMA_FINISH);
-        if ((ret == LZMA_OK) || (ret == LZMA_STREAM_END))
+        w = h = sizes[s];
+        initial = malloc(w * h * sizeof(Cell));
+        cells = malloc(w * h * sizeof(Cell));
+        records = malloc(w * h * sizeof(Snapshot_Record));
+        decoded = malloc(w * h * sizeof(Snapshot_Record));
+        if (EINA_UNLIKELY(!initial || !cells || !records || !decoded))
           {
-             INF("Ok, done");
+             CRI("Failed to allocate memory");
+             errors++;
+             goto next;
           }
-        else
+        memset(initial, 0, w * h * sizeof(Cell));
+        for (k = 0; k < w * h; k++)
           {
-             CRI("Something went wrong: 0x%x", ret);
+             initial[k].unit_below = PUD_UNIT_NONE;
+             initial[k].unit_above = PUD_UNIT_NONE;
+             initial[k].start_location = CELL_NOT_START_LOCATION;
+             _bench_tile_set(&(initial[k]), TILE_GRASS_LIGHT, TILE_GRASS_LIGHT,
+                             TILE_GRASS_LIGHT, TILE_GRASS_LIGHT, 0x0050);
           }
-     }
-   else
-     CRI("Something went wrong: 0x%x", ret);
-   lzma_end(&stream);
 
-   editor_units_recount(ed);
-   editor_units_list_update(ed);
-   bitmap_refresh(ed, NULL);
-   minimap_reload(ed);
-   editor_changed(ed);
+        for (bench = 0; bench < __SNAPSHOT_BENCH_LAST; bench++)
+          {
+             /* Same edits for all the codecs */
+             prng_init(&prng, 0x5eed, bench);
+             memcpy(cells, initial, w * h * sizeof(Cell));
+             count = _bench_record(bench, cells, w, h, &prng, records);
 
-   return EINA_TRUE;
+             for (c = 0; (codec = codec_nth_get(c)) != NULL; c++)
+               {
+                  t_push = 0.0;
+                  t_rollback = 0.0;
+                  for (l = 0; l < loops; l++)
+                    {
+                       out_size = 0;
+                       start = ecore_time_get();
+                       if (!_records_encode(codec, records, count,
+                                            &out, &out_size))
+                         {
+                            ERR("%s: failed to encode", codec->name);
+                            errors++;
+                            break;
+                         }
+                       t_push += ecore_time_get() - start;
+
+                       /* Undo: decode, then restore the cells */
+                       start = ecore_time_get();
+                       if (!_records_decode(codec, out, out_size, count,
+                                            decoded))
+                         {
+                            ERR("%s: failed to decode", codec->name);
+                            errors++;
+                            free(out);
+                            break;
+                         }
+                       for (k = 0; k < count; k++)
+                         cells[decoded[k].cell] = decoded[k].before;
+                       t_rollback += ecore_time_get() - start;
+                       free(out);
+
+                       for (k = 0; k < count; k++)
+                         if ((records[k].cell != decoded[k].cell) ||
+                             memcmp(&(records[k].after), &(decoded[k].after),
+                                    sizeof(Cell)))
+                           break;
+                       if ((k != count) ||
+                           memcmp(cells, initial, w * h * sizeof(Cell)))
+                         {
+                            ERR("%s: undo does not restore the map",
+                                codec->name);
+                            errors++;
+                            break;
+                         }
+                       for (k = 0; k < count; k++)
+                         cells[records[k].cell] = records[k].after;
+                    }
+
+                  /* Sizes and times of a failed codec mean nothing */
+                  if (l != loops)
+                    {
+                       printf("snapshot: %-9s %-10s %3ux%-3u %6u %9s\n",
+                              _bench_names[bench], codec->name, w, h, count,
+                              "failed");
+                       continue;
+                    }
+                  printf("snapshot: %-9s %-10s %3ux%-3u %6u %9zu %6.1f%% "
+                         "%10.3f %10.3f\n",
+                         _bench_names[bench], codec->name, w, h, count,
+                         out_size,
+                         (count) ? 100.0 * (double)out_size /
+                                   (double)SNAPSHOT_PLANES_SIZE(count) : 0.0,
+                         t_push * 1000.0 / loops,
+                         t_rollback * 1000.0 / loops);
+               }
+          }
+next:
+        free(initial);
+        free(cells);
+        free(records);
+        free(decoded);
+     }
+   printf("snapshot: %u errors\n", errors);
+
+   return (errors == 0);
 }
@@ -23,13 +23,35 @@
 #ifndef __SNAPSHOT_H__
 #define __SNAPSHOT_H__
 
+/*
+ * Undo history. Edits are made within transactions (snapshot_push() and
+ * snapshot_push_done()), and every cell they modify must be touched
+ * before it is: the history records its state before and after. Undo
+ * and redo only restore (and refresh) the cells that changed.
+ */
+
+typedef struct _Snapshot_Record Snapshot_Record;
+
 Eina_Bool snapshot_add(Editor *ed);
 void snapshot_del(Editor *ed);
+void snapshot_clear(Editor *ed);
 
 void snapshot_pop(Editor *ed);
 Eina_Bool snapshot_rollback(Editor *ed, int offset);
 void snapshot_push(Editor *ed);
 void snapshot_push_done(Editor *ed);
 Eina_Bool snapshot_force_push(Editor *ed);
+void snapshot_cell_touch(Editor *ed, unsigned int x, unsigned int y);
+
+/*
+ * Memory held by the undo and redo stacks of an editor, and by all the
+ * editors. They are bounded by budgets (WAR2EDIT_UNDO_BUDGET per editor
+ * and WAR2EDIT_UNDO_BUDGET_TOTAL, in MiB): oldest entries are evicted.
+ */
+void snapshot_bytes_get(const Editor *ed, size_t *undo, size_t *redo);
+size_t snapshot_bytes_total_get(void);
+
+/* Encoding and undo of synthetic edits, with every codec */
+Eina_Bool snapshot_benchmark(void);
 
 #endif /* ! __SNAPSHOT_H__ */
@@ -27,29 +27,59 @@
 #define SELECTION_3x3 "sel/3x3"
 #define SELECTION_4x4 "sel/4x4"
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+/* Player colors are found in at most 4 different shades */
+#define PALETTE_MAX 4
+
 static Eet_File *_units_ef = NULL;
 static Eet_File *_buildings[4] = { NULL, NULL, NULL, NULL };
 static Eina_Hash *_sprites = NULL;
 static cairo_surface_t *_sels[4] = { NULL, NULL, NULL, NULL };
 
+/*
+ * Sprites are stored with the red player colors. The colors that are
+ * subject to a player conversion are discovered when sprites are loaded,
+ * and their conversion for each player is pre-calculated once. Colors are
+ * stored as 0x00RRGGBB.
+ */
+static struct {
+   uint32_t     from[PALETTE_MAX];
+   uint32_t     to[SPRITE_COLORS_MAX][PALETTE_MAX];
+   unsigned int count;
+   Eina_Hash   *checked; /* Colors known not to be player colors */
+} _palette;
+
 
 static Sprite_Descriptor *
 _sprite_descriptor_new(unsigned char *data,
                        unsigned int   w,
-                       unsigned int   h)
+                       unsigned int   h,
+                       Pud_Player     color)
 {
    Sprite_Descriptor *d;
 
-   d = malloc(sizeof(*d));
+   d = calloc(1, sizeof(*d));
    if (EINA_UNLIKELY(!d))
      {
         CRI("Failed to allocate memory");
         return NULL;
      }
+   d->surf = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, w, h,
+                                                 cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w));
+   if (EINA_UNLIKELY(cairo_surface_status(d->surf) != CAIRO_STATUS_SUCCESS))
+     {
+        CRI("Failed to create cairo surface for sprite");
+        cairo_surface_destroy(d->surf);
+        free(d);
+        return NULL;
+     }
    d->data = data;
    d->w = w;
    d->h = h;
-   d->color = PUD_PLAYER_RED;
+   d->color = color;
 
    return d;
 }
@@ -57,13 +87,162 @@ _sprite_descriptor_new(unsigned char *data,
 static void
 _sprite_descriptor_free(Sprite_Descriptor *d)
 {
+   unsigned int i;
+
    if (d)
      {
+        for (i = 0; i < EINA_C_ARRAY_LENGTH(d->variants); ++i)
+          if (d->variants[i] != d)
+            _sprite_descriptor_free(d->variants[i]);
+        for (i = 0; i < EINA_C_ARRAY_LENGTH(d->mips); ++i)
+          _sprite_descriptor_free(d->mips[i]);
+        cairo_surface_destroy(d->surf);
         free(d->data);
         free(d);
      }
 }
 
+static void
+_palette_color_add(uint32_t rgb)
+{
+   unsigned int p;
+   unsigned char r, g, b;
+
+   if (EINA_UNLIKELY(_palette.count >= PALETTE_MAX))
+     {
+        ERR("Too many player colors. Color 0x%06x will not be converted", rgb);
+        return;
+     }
+
+   /* Only players 0-7 and the neutral one exist: others keep the color */
+   for (p = 0; p < SPRITE_COLORS_MAX; ++p)
+     {
+        if ((p <= PUD_PLAYER_YELLOW) || (p == PUD_PLAYER_NEUTRAL))
+          {
+             war2_sprites_color_convert(PUD_PLAYER_RED, p,
+                                        (rgb >> 16) & 0xff, (rgb >> 8) & 0xff,
+                                        rgb & 0xff, &r, &g, &b);
+             _palette.to[p][_palette.count] = (r << 16) | (g << 8) | b;
+          }
+        else
+          _palette.to[p][_palette.count] = rgb;
+     }
+   _palette.from[_palette.count++] = rgb;
+   DBG("Player color 0x%06x registered", rgb);
+}
+
+static void
+_palette_discover(const uint32_t *px,
+                  unsigned int    count)
+{
+   uint32_t rgb, last = 0;
+   unsigned int i, k;
+   unsigned char r, g, b;
+
+   for (i = 0; i < count; ++i)
+     {
+        rgb = px[i] & 0x00ffffff;
+        if ((i > 0) && (rgb == last)) continue;
+        last = rgb;
+
+        for (k = 0; k < _palette.count; ++k)
+          if (_palette.from[k] == rgb) break;
+        if (k < _palette.count) continue;
+        if (eina_hash_find(_palette.checked, &rgb)) continue;
+
+        /* A player color is converted when going from red to blue */
+        war2_sprites_color_convert(PUD_PLAYER_RED, PUD_PLAYER_BLUE,
+                                   (rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff,
+                                   &r, &g, &b);
+        if (((uint32_t)(r << 16) | (g << 8) | b) != rgb)
+          _palette_color_add(rgb);
+        else
+          eina_hash_add(_palette.checked, &rgb, (void *)(uintptr_t)1);
+     }
+}
+
+static void
+_palette_remap(uint32_t *restrict       dst,
+               const uint32_t *restrict src,
+               unsigned int             count,
+               Pud_Player               color)
+{
+   const uint32_t *const to = _palette.to[color];
+   const unsigned int colors = _palette.count;
+   unsigned int i = 0, k;
+   uint32_t px;
+
+   /*
+    * For each pixel which RGB matches a player color, XOR-ing it with
+    * (from ^ to) gives the converted color, with alpha untouched.
+    */
+#if defined(__SSE2__)
+   const __m128i rgb_mask = _mm_set1_epi32(0x00ffffff);
+   __m128i v, out, m;
+
+   for (; i + 4 <= count; i += 4)
+     {
+        v = _mm_loadu_si128((const __m128i *)(src + i));
+        out = v;
+        v = _mm_and_si128(v, rgb_mask);
+        for (k = 0; k < colors; ++k)
+          {
+             m = _mm_cmpeq_epi32(v, _mm_set1_epi32(_palette.from[k]));
+             m = _mm_and_si128(m, _mm_set1_epi32(_palette.from[k] ^ to[k]));
+             out = _mm_xor_si128(out, m);
+          }
+        _mm_storeu_si128((__m128i *)(dst + i), out);
+     }
+#endif
+   for (; i < count; ++i)
+     {
+        px = src[i];
+        for (k = 0; k < colors; ++k)
+          {
+             if ((px & 0x00ffffff) == _palette.from[k])
+               {
+                  px ^= _palette.from[k] ^ to[k];
+                  break;
+               }
+          }
+        dst[i] = px;
+     }
+}
+
+static Sprite_Descriptor *
+_sprite_variant_get(Sprite_Descriptor *orig,
+                    Pud_Player         color)
+{
+   Sprite_Descriptor *d;
+   unsigned char *data;
+   const size_t size = orig->w * orig->h * 4;
+
+   EINA_SAFETY_ON_TRUE_RETURN_VAL((unsigned int)color >= SPRITE_COLORS_MAX, NULL);
+
+   d = orig->variants[color];
+   if (d) return d;
+
+   data = malloc(size);
+   if (EINA_UNLIKELY(!data))
+     {
+        CRI("Failed to allocate memory");
+        return NULL;
+     }
+   _palette_remap((uint32_t *)data, (const uint32_t *)orig->data,
+                  orig->w * orig->h, color);
+   stats_add(STATS_RECOLOR_PIXELS, orig->w * orig->h);
+
+   d = _sprite_descriptor_new(data, orig->w, orig->h, color);
+   if (EINA_UNLIKELY(!d))
+     {
+        free(data);
+        return NULL;
+     }
+   orig->variants[color] = d;
+
+   return d;
+}
+
 
 static void *
 _sprite_load(Eet_File     *src,
@@ -141,10 +320,46 @@ sprite_buildings_open(Pud_Era era)
    return ef;
 }
 
+Sprite_Descriptor *
+sprite_mip_get(Sprite_Descriptor *d,
+               unsigned int       level)
+{
+   Sprite_Descriptor *parent, *mip;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(d, NULL);
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(level >= ATLAS_MIP_LEVELS, NULL);
+
+   if (level == 0) return d;
+   if (d->mips[level - 1]) return d->mips[level - 1];
+
+   parent = sprite_mip_get(d, level - 1);
+   if (EINA_UNLIKELY(!parent)) return NULL;
+
+   mip = calloc(1, sizeof(*mip));
+   if (EINA_UNLIKELY(!mip))
+     {
+        CRI("Failed to allocate memory");
+        return NULL;
+     }
+   mip->surf = blit_surface_downsample(parent->surf);
+   if (EINA_UNLIKELY(!mip->surf))
+     {
+        free(mip);
+        return NULL;
+     }
+   mip->w = cairo_image_surface_get_width(mip->surf);
+   mip->h = cairo_image_surface_get_height(mip->surf);
+   mip->color = d->color;
+   d->mips[level - 1] = mip;
+
+   return mip;
+}
+
 Sprite_Descriptor *
 sprite_get(Pud_Unit       unit,
            Pud_Era        era,
            Sprite_Info    info,
+           Pud_Player     color,
            Eina_Bool     *flip_me)
 {
    unsigned char *data;
@@ -231,7 +446,7 @@ sprite_get(Pud_Unit       unit,
              return NULL;
           }
 
-        d = _sprite_descriptor_new(data, w, h);
+        d = _sprite_descriptor_new(data, w, h, PUD_PLAYER_RED);
         if (EINA_UNLIKELY(!d))
           {
              CRI("Failed to create sprite descriptor");
@@ -245,28 +460,27 @@ sprite_get(Pud_Unit       unit,
              _sprite_descriptor_free(d);
              return NULL;
           }
+        d->variants[PUD_PLAYER_RED] = d;
+        _palette_discover((const uint32_t *)data, w * h);
         //DBG("Access key [%s] (not yet registered). SRT = <%p>", key, data);
-        return d;
-     }
-   else
-     {
-        //DBG("Access key [%s] (already registered). SRT = <%p>", key, data);
-        return d;
      }
+
+   /* Each color is converted once, then kept in cache */
+   return _sprite_variant_get(d, color);
 }
 
 Sprite_Info
-sprite_info_random_get(void)
+sprite_info_random_get(Prng *prng)
 {
    /* Does not return 4 */
-   return rand() % (SPRITE_INFO_NORTH_WEST - SPRITE_INFO_NORTH) + SPRITE_INFO_NORTH;
+   return prng_below(prng, SPRITE_INFO_NORTH_WEST - SPRITE_INFO_NORTH) + SPRITE_INFO_NORTH;
 }
 
 
 static void
 _free_cb(void *data)
 {
-   free(data);
+   _sprite_descriptor_free(data);
 }
 
 Eina_Bool
@@ -298,6 +512,14 @@ sprite_init(void)
         goto sprites_fail;
      }
 
+   _palette.count = 0;
+   _palette.checked = eina_hash_int32_new(NULL);
+   if (EINA_UNLIKELY(!_palette.checked))
+     {
+        CRI("Failed to create Hash for colors");
+        goto palette_fail;
+     }
+
    /* Load selection sprites */
    for (i = 0; i < (int)EINA_C_ARRAY_LENGTH(_sels); i++)
      {
@@ -326,6 +548,9 @@ surf_fail:
         _sels[i] = NULL;
      }
 sel_fail:
+   eina_hash_free(_palette.checked);
+   _palette.checked = NULL;
+palette_fail:
    eina_hash_free(_sprites);
 sprites_fail:
    eet_close(_units_ef);
@@ -357,6 +582,8 @@ sprite_shutdown(void)
    _units_ef = NULL;
    eina_hash_free(_sprites);
    _sprites = NULL;
+   eina_hash_free(_palette.checked);
+   _palette.checked = NULL;
 }
 
 void
@@ -36,20 +36,33 @@ typedef enum
    SPRITE_INFO_ICON , /* special value for icons */
 } Sprite_Info;
 
-typedef struct
+/* Pud_Player is stored on 4 bits */
+#define SPRITE_COLORS_MAX 16
+
+typedef struct _Sprite_Descriptor Sprite_Descriptor;
+
+struct _Sprite_Descriptor
 {
-   unsigned char *data;
-   unsigned int w;
-   unsigned int h;
-   Pud_Player   color;
-} Sprite_Descriptor;
+   unsigned char   *data;
+   cairo_surface_t *surf; /* Wraps data */
+   unsigned int     w;
+   unsigned int     h;
+   Pud_Player       color;
+
+   /* Colorized copies of the sprite, lazily created (original only) */
+   Sprite_Descriptor *variants[SPRITE_COLORS_MAX];
+
+   /* Downsampled copies of the sprite, for zoomed-out views */
+   Sprite_Descriptor *mips[ATLAS_MIP_LEVELS - 1];
+};
 
 
 Sprite_Descriptor *sprite_get(Pud_Unit unit, Pud_Era era, Sprite_Info info,
-                              Eina_Bool *flip_me);
+                              Pud_Player color, Eina_Bool *flip_me);
+Sprite_Descriptor *sprite_mip_get(Sprite_Descriptor *d, unsigned int level);
 Eet_File *sprite_buildings_open(Pud_Era era);
 Eet_File *sprite_units_open(void);
-Sprite_Info sprite_info_random_get(void);
+Sprite_Info sprite_info_random_get(Prng *prng);
 
 Eina_Bool sprite_init(void);
 void sprite_shutdown(void);
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+#include <inttypes.h>
+
+uint64_t _stats_counters[__STATS_LAST];
+
+static Ecore_Timer *_timer = NULL;
+static uint64_t _last[__STATS_LAST];
+
+static const char *const _names[__STATS_LAST] =
+{
+   [STATS_TILES]              = "tiles",
+   [STATS_SPRITES]            = "sprites",
+   [STATS_RECOLOR_PIXELS]     = "recolor_px",
+   [STATS_FILLS]              = "fills",
+   [STATS_MINIMAP_CELLS]      = "minimap_cells",
+   [STATS_PROPAGATED_CELLS]   = "propagated_cells",
+   [STATS_UPLOAD_BYTES]       = "upload_bytes",
+   [STATS_REFRESHES]          = "refreshes",
+   [STATS_REFRESH_USEC]       = "refresh_us",
+   [STATS_UNDO_BYTES]         = "undo_bytes",
+   [STATS_UNDO_EVICTIONS]     = "undo_evictions",
+};
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static Eina_Bool
+_stats_dump_cb(void *data EINA_UNUSED)
+{
+   uint64_t now[__STATS_LAST], d[__STATS_LAST];
+   unsigned int i;
+
+   stats_get(now);
+   for (i = 0; i < __STATS_LAST; ++i)
+     {
+        d[i] = now[i] - _last[i];
+        _last[i] = now[i];
+     }
+
+   /* Nothing was drawn: don't flood the logs */
+   if ((d[STATS_REFRESHES] == 0) && (d[STATS_UPLOAD_BYTES] == 0))
+     return ECORE_CALLBACK_RENEW;
+
+   INF("Stats: %"PRIu64" refreshes in %.3f ms (%.3f ms avg), "
+       "%"PRIu64" tiles, %"PRIu64" sprites, %"PRIu64" recolored pixels, "
+       "%"PRIu64" fills, %"PRIu64" minimap cells, %"PRIu64" propagated cells, "
+       "%"PRIu64" bytes uploaded, %"PRIu64" bytes of undo history "
+       "(%"PRIu64" entries evicted)",
+       d[STATS_REFRESHES], (double)d[STATS_REFRESH_USEC] / 1000.0,
+       (d[STATS_REFRESHES])
+       ? ((double)d[STATS_REFRESH_USEC] / 1000.0) / (double)d[STATS_REFRESHES]
+       : 0.0,
+       d[STATS_TILES], d[STATS_SPRITES], d[STATS_RECOLOR_PIXELS],
+       d[STATS_FILLS], d[STATS_MINIMAP_CELLS], d[STATS_PROPAGATED_CELLS],
+       d[STATS_UPLOAD_BYTES], now[STATS_UNDO_BYTES], d[STATS_UNDO_EVICTIONS]);
+
+   return ECORE_CALLBACK_RENEW;
+}
+
+
+/*============================================================================*
+ *                                Init/Shutdown                               *
+ *============================================================================*/
+
+Eina_Bool
+stats_init(void)
+{
+   memset(_stats_counters, 0, sizeof(_stats_counters));
+   memset(_last, 0, sizeof(_last));
+   return EINA_TRUE;
+}
+
+void
+stats_shutdown(void)
+{
+   if (_timer)
+     {
+        ecore_timer_del(_timer);
+        _timer = NULL;
+     }
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+void
+stats_get(uint64_t values[__STATS_LAST])
+{
+   unsigned int i;
+
+   for (i = 0; i < __STATS_LAST; ++i)
+     values[i] = __atomic_load_n(&(_stats_counters[i]), __ATOMIC_RELAXED);
+}
+
+const char *
+stats_name_get(Stats_Counter counter)
+{
+   EINA_SAFETY_ON_TRUE_RETURN_VAL((unsigned) counter >= __STATS_LAST, NULL);
+   return _names[counter];
+}
+
+Eina_Bool
+stats_dump_start(double interval)
+{
+   EINA_SAFETY_ON_TRUE_RETURN_VAL(interval <= 0.0, EINA_FALSE);
+
+   if (_timer) ecore_timer_del(_timer);
+   _timer = ecore_timer_add(interval, _stats_dump_cb, NULL);
+   if (EINA_UNLIKELY(!_timer))
+     {
+        CRI("Failed to create timer");
+        return EINA_FALSE;
+     }
+
+   /* Statistics are logged as infos: make sure they are visible */
+   if (eina_log_domain_registered_level_get(_war2edit_log_dom) < EINA_LOG_LEVEL_INFO)
+     eina_log_domain_level_set("war2edit", EINA_LOG_LEVEL_INFO);
+
+   stats_get(_last);
+   return EINA_TRUE;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/*
+ * Rendering and undo history counters. They are global (sprites and
+ * atlases are shared by all the editors), cumulative (but the bytes of
+ * undo history, which are a level), and may be incremented from worker
+ * threads. They can be logged periodically (--stats) and are displayed
+ * per frame by the debug HUD.
+ */
+
+typedef enum
+{
+   STATS_TILES             = 0, /* Tiles copied in the terrain layer */
+   STATS_SPRITES,               /* Sprites drawn */
+   STATS_RECOLOR_PIXELS,        /* Sprite pixels remapped to a player color */
+   STATS_FILLS,                 /* Calls to cairo_fill() */
+   STATS_MINIMAP_CELLS,         /* Cells drawn in the minimap */
+   STATS_PROPAGATED_CELLS,      /* Cells solved by the tile propagation */
+   STATS_UPLOAD_BYTES,          /* Bytes passed to evas as damages */
+   STATS_REFRESHES,             /* Calls to bitmap_refresh() */
+   STATS_REFRESH_USEC,          /* Time spent in bitmap_refresh() */
+   STATS_UNDO_BYTES,            /* Held by the undo histories (not cumulative) */
+   STATS_UNDO_EVICTIONS,        /* Undo entries evicted by the budgets */
+
+   __STATS_LAST /* Sentinel */
+} Stats_Counter;
+
+/* Period of the logs, in seconds */
+#define STATS_DUMP_INTERVAL 1.0
+
+extern uint64_t _stats_counters[__STATS_LAST];
+
+Eina_Bool stats_init(void);
+void stats_shutdown(void);
+
+static inline void
+stats_add(Stats_Counter counter,
+          uint64_t      value)
+{
+   __atomic_fetch_add(&(_stats_counters[counter]), value, __ATOMIC_RELAXED);
+}
+
+void stats_get(uint64_t values[__STATS_LAST]);
+const char *stats_name_get(Stats_Counter counter);
+Eina_Bool stats_dump_start(double interval);
+
+#endif /* ! _STATS_H_ */
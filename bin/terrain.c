@@ -0,0 +1,750 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/* Cap on the relaxation steps. Solving a map usually takes a few. */
+#define TERRAIN_ITERATIONS_MAX 64
+
+/* Bound of the repair, in visits per vertex */
+#define TERRAIN_REPAIR_VISITS_MAX 16
+
+/* Rows of vertices per band, at least */
+#define TERRAIN_BAND_MIN 8
+
+/*
+ * The fragments of a cell are its corners: the top-right fragment of a
+ * cell is the top-left fragment of its right neighbour, and so on. The
+ * terrain is therefore solved on the (map_w + 1) x (map_h + 1) grid of
+ * the vertices, and two vertices must hold compatible fragments when they
+ * belong to a same cell (i.e. when they are 8-neighbours).
+ *
+ * Each vertex holds a rank: the cell that imposed it. As in the editor,
+ * the cells that are placed last win: when two vertices conflict, the one
+ * of lower rank is resolved to a fragment compatible with the other, and
+ * takes its rank, so the resolution spreads away from it. Vertices that
+ * no cell constrains (e.g. surrounded by walls) are not active, and two
+ * vertices only constrain each other through a cell that takes part.
+ */
+typedef struct
+{
+   uint8_t      *values[2];
+   uint32_t     *ranks[2];
+   uint8_t      *active;
+   uint8_t      *cells;    /* Per cell: whether it takes part */
+   unsigned int *changes;  /* Per band */
+   unsigned int  w;
+   unsigned int  h;
+   unsigned int  band_h;
+   unsigned int  cur;      /* Buffers being read */
+
+   /* Writing of the tiles, in bands of cells */
+   Editor        *ed;
+   const uint8_t *write;   /* Per cell: TERRAIN_WRITE_* */
+   uint64_t       seed;    /* Of the random streams of the bands */
+} Terrain;
+
+typedef enum
+{
+   TERRAIN_WRITE_NONE   = 0, /* Cell is left as it is */
+   TERRAIN_WRITE_BAND   = 1, /* Tile is written by its band */
+   TERRAIN_WRITE_SERIAL = 2, /* Tile replaces a wall: set on the main thread */
+} Terrain_Write;
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+/*
+ * Whether a cell that takes part holds both the vertex (x, y) and its
+ * neighbour (x + i, y + j). Cells are the ones of a map of w - 1 by h - 1.
+ */
+static inline Eina_Bool
+_terrain_linked_are(const uint8_t *cells,
+                    unsigned int   w,
+                    unsigned int   h,
+                    unsigned int   x,
+                    unsigned int   y,
+                    int            i,
+                    int            j)
+{
+   const unsigned int map_w = w - 1;
+   const unsigned int map_h = h - 1;
+   const unsigned int nx = x + i;
+   const unsigned int ny = y + j;
+   unsigned int cx, cy, x1, x2, y1, y2;
+
+   /* A cell holds the vertices at its column/row and the next one */
+   x1 = MAX(x, nx);
+   x1 = (x1 > 0) ? x1 - 1 : 0;
+   x2 = MIN(MIN(x, nx), map_w - 1);
+   y1 = MAX(y, ny);
+   y1 = (y1 > 0) ? y1 - 1 : 0;
+   y2 = MIN(MIN(y, ny), map_h - 1);
+
+   for (cy = y1; cy <= y2; ++cy)
+     for (cx = x1; cx <= x2; ++cx)
+       if (cells[(cy * map_w) + cx])
+         return EINA_TRUE;
+   return EINA_FALSE;
+}
+
+/*
+ * Neighbour the vertex (x, y) has to give way to: the highest ranked of
+ * the ones that rank above it and hold an incompatible fragment, through
+ * a cell that takes part. -1 if none. Vertices that are not active are
+ * ignored.
+ */
+static int
+_terrain_winner_get(const uint8_t  *vals,
+                    const uint32_t *ranks,
+                    const uint8_t  *active,
+                    const uint8_t  *cells,
+                    unsigned int    w,
+                    unsigned int    h,
+                    unsigned int    x,
+                    unsigned int    y)
+{
+   const unsigned int v = (y * w) + x;
+   unsigned int u;
+   int i, j, winner = -1;
+
+   for (j = -1; j <= 1; ++j)
+     for (i = -1; i <= 1; ++i)
+       {
+          if (((i == 0) && (j == 0)) ||
+              ((int)x + i < 0) || ((int)x + i >= (int)w) ||
+              ((int)y + j < 0) || ((int)y + j >= (int)h))
+            continue;
+
+          u = ((y + j) * w) + (x + i);
+          if (!active[u])
+            continue;
+
+          /* Only the vertices that rank above may impose */
+          if ((ranks[u] < ranks[v]) ||
+              ((ranks[u] == ranks[v]) && (u < v)))
+            continue;
+          if (tile_fragments_compatible_are(vals[u], vals[v]))
+            continue;
+          if (!_terrain_linked_are(cells, w, h, x, y, i, j))
+            continue;
+          if ((winner < 0) ||
+              (ranks[u] > ranks[winner]) ||
+              ((ranks[u] == ranks[winner]) && (u > (unsigned int)winner)))
+            winner = u;
+       }
+
+   return winner;
+}
+
+/*
+ * One relaxation step on a band of vertices. The band reads the buffers of
+ * the previous step, including the rows of its neighbour bands (its halo),
+ * and writes the other buffers: bands never write what others read.
+ */
+static void
+_terrain_band_cb(void         *data,
+                 unsigned int  job)
+{
+   Terrain *const t = data;
+   const uint8_t *const vals = t->values[t->cur];
+   const uint32_t *const ranks = t->ranks[t->cur];
+   uint8_t *const next_vals = t->values[!t->cur];
+   uint32_t *const next_ranks = t->ranks[!t->cur];
+   const unsigned int y1 = job * t->band_h;
+   const unsigned int y2 = MIN(y1 + t->band_h, t->h);
+   unsigned int x, y, v, changes = 0;
+   int winner;
+
+   for (y = y1; y < y2; ++y)
+     for (x = 0; x < t->w; ++x)
+       {
+          v = (y * t->w) + x;
+          winner = (t->active[v])
+             ? _terrain_winner_get(vals, ranks, t->active, t->cells,
+                                   t->w, t->h, x, y)
+             : -1;
+
+          if (winner >= 0)
+            {
+               next_vals[v] = tile_conflict_resolve_get(vals[winner], vals[v]);
+               next_ranks[v] = ranks[winner];
+               changes++;
+            }
+          else
+            {
+               next_vals[v] = vals[v];
+               next_ranks[v] = ranks[v];
+            }
+       }
+
+   t->changes[job] = changes;
+}
+
+static Eina_Bool
+_terrain_relax(Terrain      *t,
+               unsigned int  bands)
+{
+   unsigned int it, k, changes;
+
+   for (it = 0; it < TERRAIN_ITERATIONS_MAX; ++it)
+     {
+        parallel_run(bands, _terrain_band_cb, t);
+        t->cur = !t->cur;
+
+        for (k = 0, changes = 0; k < bands; ++k)
+          changes += t->changes[k];
+        if (changes == 0)
+          {
+             DBG("Terrain solved in %u steps", it + 1);
+             return EINA_TRUE;
+          }
+     }
+
+   ERR("Terrain did not converge after %u steps", TERRAIN_ITERATIONS_MAX);
+   return EINA_FALSE;
+}
+
+/*
+ * Sets the fragments and the tiles of a band of cells, from the solved
+ * vertices. Each band draws the variants of its tiles from its own
+ * stream, so the result does not depend on how bands are scheduled.
+ * Cells are distinct for each band: they are written directly.
+ */
+static void
+_terrain_tiles_cb(void         *data,
+                  unsigned int  job)
+{
+   Terrain *const t = data;
+   Editor *const ed = t->ed;
+   const uint8_t *const vals = t->values[t->cur];
+   const unsigned int map_w = t->w - 1;
+   const unsigned int y1 = job * t->band_h;
+   const unsigned int y2 = MIN(y1 + t->band_h, t->h - 1);
+   unsigned int x, y, v;
+   Prng prng;
+   Cell *c;
+
+   prng_init(&prng, t->seed, job);
+   for (y = y1; y < y2; ++y)
+     for (x = 0; x < map_w; ++x)
+       {
+          if (t->write[(y * map_w) + x] != TERRAIN_WRITE_BAND)
+            continue;
+
+          v = (y * t->w) + x;
+          c = &(ed->cells[y][x]);
+          c->tile_tl = vals[v];
+          c->tile_tr = vals[v + 1];
+          c->tile_bl = vals[v + t->w];
+          c->tile_br = vals[v + t->w + 1];
+          c->tile = tile_calculate(c->tile_tl, c->tile_tr,
+                                   c->tile_bl, c->tile_br,
+                                   TILE_RANDOMIZE, ed->pud->era, &prng);
+       }
+}
+
+/* Claims vertex v for a cell. Cells of rank 0 only take free vertices. */
+static inline void
+_terrain_vertex_claim(Terrain      *t,
+                      unsigned int  v,
+                      uint8_t       value,
+                      uint32_t      rank)
+{
+   if ((rank == 0) && t->active[v])
+     return;
+   t->values[0][v] = value;
+   t->ranks[0][v] = rank;
+   t->active[v] = 1;
+}
+
+/*
+ * Walls are not repaired (their fragments are sides, not corners), nor
+ * cells whose tile is unknown (TILE_NONE fragments).
+ */
+static inline Eina_Bool
+_terrain_cell_skipped_is(const uint8_t *f)
+{
+   return ((f[0] == TILE_NONE) || (f[1] == TILE_NONE) ||
+           (f[2] == TILE_NONE) || (f[3] == TILE_NONE) ||
+           tile_wall_is(f[0], f[1], f[2], f[3]));
+}
+
+/* Whether the fragments of a cell are compatible with each other */
+static inline Eina_Bool
+_terrain_cell_valid_is(const uint8_t *f)
+{
+   return (tile_fragments_compatible_are(f[0], f[1]) &&
+           tile_fragments_compatible_are(f[0], f[2]) &&
+           tile_fragments_compatible_are(f[0], f[3]) &&
+           tile_fragments_compatible_are(f[1], f[2]) &&
+           tile_fragments_compatible_are(f[1], f[3]) &&
+           tile_fragments_compatible_are(f[2], f[3]));
+}
+
+/*
+ * Repairs the fragments of a map (4 per cell: tl, tr, bl, br), in place.
+ * The vertices are claimed by the cells that hold them, and the ones in
+ * conflict are queued. A vertex that gives way queues its neighbours,
+ * so the work is proportional to the cells that actually change.
+ * The vertices of the cells that are already valid rank above the
+ * others, so the invalid cells are the ones that give way.
+ * changed[] flags the cells whose fragments were modified.
+ */
+static Eina_Bool
+_terrain_repair(uint8_t      *frags,
+                unsigned int  map_w,
+                unsigned int  map_h,
+                uint8_t      *changed,
+                unsigned int *count)
+{
+   const unsigned int w = map_w + 1;
+   const unsigned int h = map_h + 1;
+   const unsigned int size = w * h;
+   uint8_t *vals, *active, *disputed, *queued, *cells, *f;
+   uint32_t *ranks, *fifo;
+   unsigned int x, y, v, k, n, head = 0, queue = 0, visits = 0;
+   unsigned int corners[4];
+   int i, j, winner;
+   Eina_Bool ok = EINA_FALSE, valid;
+
+   *count = 0;
+   vals = calloc(size, sizeof(uint8_t));
+   active = calloc(size, sizeof(uint8_t));
+   disputed = calloc(size, sizeof(uint8_t));
+   queued = calloc(size, sizeof(uint8_t));
+   cells = calloc(map_w * map_h, sizeof(uint8_t));
+   ranks = calloc(size, sizeof(uint32_t));
+   fifo = malloc(size * sizeof(uint32_t));
+   if (EINA_UNLIKELY(!vals || !active || !disputed || !queued ||
+                     !cells || !ranks || !fifo))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+#define _QUEUE(V) \
+   do { \
+      if (!queued[V]) { \
+         queued[V] = 1; \
+         fifo[(head + queue) % size] = (V); \
+         queue++; \
+      } \
+   } while (0)
+
+#define _CORNERS_GET(X, Y) \
+   do { \
+      corners[0] = ((Y) * w) + (X); \
+      corners[1] = corners[0] + 1; \
+      corners[2] = corners[0] + w; \
+      corners[3] = corners[0] + w + 1; \
+   } while (0)
+
+   /*
+    * Claims: the first cell (in raster order) holding a vertex gives its
+    * value. A cell that disagrees with it makes the vertex disputed.
+    */
+   for (y = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x)
+       {
+          f = &(frags[((y * map_w) + x) * 4]);
+          if (_terrain_cell_skipped_is(f))
+            continue;
+          cells[(y * map_w) + x] = 1;
+          _CORNERS_GET(x, y);
+          for (n = 0; n < 4; ++n)
+            {
+               v = corners[n];
+               if (!active[v])
+                 {
+                    vals[v] = f[n];
+                    active[v] = 1;
+                 }
+               else if (vals[v] != f[n])
+                 disputed[v] = 1;
+            }
+       }
+
+   /* Ranks: the vertices of the valid cells impose on the others */
+   for (y = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x)
+       {
+          f = &(frags[((y * map_w) + x) * 4]);
+          if (_terrain_cell_skipped_is(f) || !_terrain_cell_valid_is(f))
+            continue;
+          _CORNERS_GET(x, y);
+          for (n = 0, valid = EINA_TRUE; (n < 4) && valid; ++n)
+            valid = !disputed[corners[n]];
+          if (valid)
+            for (n = 0; n < 4; ++n)
+              ranks[corners[n]] = 1;
+       }
+
+   /* Scan of all the edges: queue the vertices in conflict */
+   for (y = 0; y < h; ++y)
+     for (x = 0; x < w; ++x)
+       {
+          v = (y * w) + x;
+          if (active[v] &&
+              (_terrain_winner_get(vals, ranks, active, cells, w, h, x, y) >= 0))
+            _QUEUE(v);
+       }
+
+   while (queue > 0)
+     {
+        v = fifo[head];
+        head = (head + 1) % size;
+        queue--;
+        queued[v] = 0;
+
+        x = v % w;
+        y = v / w;
+        winner = _terrain_winner_get(vals, ranks, active, cells, w, h, x, y);
+        if (winner < 0)
+          continue;
+
+        if (EINA_UNLIKELY(++visits > size * TERRAIN_REPAIR_VISITS_MAX))
+          {
+             ERR("Repair of the terrain does not converge");
+             goto end;
+          }
+
+        vals[v] = tile_conflict_resolve_get(vals[winner], vals[v]);
+        ranks[v] = ranks[winner];
+
+        /* Its neighbours may now be in conflict with it */
+        for (j = -1; j <= 1; ++j)
+          for (i = -1; i <= 1; ++i)
+            {
+               if (((int)x + i < 0) || ((int)x + i >= (int)w) ||
+                   ((int)y + j < 0) || ((int)y + j >= (int)h))
+                 continue;
+               k = ((y + j) * w) + (x + i);
+               if (active[k]) _QUEUE(k);
+            }
+     }
+
+#undef _QUEUE
+
+   /*
+    * Cells take their fragments back from their corners. Until then, frags
+    * holds the original fragments: only the cells that differ from them
+    * are flagged.
+    */
+   for (y = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x)
+       {
+          k = (y * map_w) + x;
+          f = &(frags[k * 4]);
+          if (_terrain_cell_skipped_is(f))
+            continue;
+          _CORNERS_GET(x, y);
+          for (n = 0; n < 4; ++n)
+            {
+               if (f[n] != vals[corners[n]])
+                 {
+                    changed[k] = 1;
+                    f[n] = vals[corners[n]];
+                 }
+            }
+          if (changed[k])
+            (*count)++;
+       }
+
+#undef _CORNERS_GET
+
+   DBG("Terrain repaired: %u vertices solved, %u cells changed",
+       visits, *count);
+   ok = EINA_TRUE;
+
+end:
+   free(vals);
+   free(active);
+   free(disputed);
+   free(queued);
+   free(cells);
+   free(ranks);
+   free(fifo);
+   return ok;
+}
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+terrain_solve(Editor        *ed,
+              const uint8_t *classes,
+              Prng          *prng)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const unsigned int map_h = ed->pud->map_h;
+   Terrain t;
+   unsigned int x, y, k, bands, v, written = 0;
+   uint32_t rank;
+   uint8_t *write = NULL;
+   uint8_t f[4];
+   Cell *c;
+   const uint8_t *vals;
+   Eina_Bool ok = EINA_FALSE;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(classes, EINA_FALSE);
+   EINA_SAFETY_ON_NULL_RETURN_VAL(prng, EINA_FALSE);
+
+   memset(&t, 0, sizeof(t));
+   t.w = map_w + 1;
+   t.h = map_h + 1;
+
+   /* More bands than workers, so they are balanced */
+   bands = parallel_workers_get() * 2;
+   t.band_h = MAX((t.h + bands - 1) / bands, TERRAIN_BAND_MIN);
+   bands = (t.h + t.band_h - 1) / t.band_h;
+
+   t.values[0] = calloc(t.w * t.h, sizeof(uint8_t));
+   t.values[1] = malloc(t.w * t.h * sizeof(uint8_t));
+   t.ranks[0] = malloc(t.w * t.h * sizeof(uint32_t));
+   t.ranks[1] = malloc(t.w * t.h * sizeof(uint32_t));
+   t.active = calloc(t.w * t.h, sizeof(uint8_t));
+   t.cells = calloc(map_w * map_h, sizeof(uint8_t));
+   t.changes = calloc(bands, sizeof(unsigned int));
+   write = calloc(map_w * map_h, sizeof(uint8_t));
+   if (EINA_UNLIKELY(!t.values[0] || !t.values[1] || !t.ranks[0] ||
+                     !t.ranks[1] || !t.active || !t.cells || !t.changes ||
+                     !write))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+   /*
+    * Each vertex is first imposed by the last cell (in raster order) it
+    * belongs to, as if the cells were placed one after the other. Cells
+    * without class keep their fragments, with the lowest rank: they only
+    * change if their neighbours impose on them. Walls do not take part.
+    */
+   for (y = 0, k = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x, ++k)
+       {
+          c = &(ed->cells[y][x]);
+          if (classes[k] != TILE_NONE)
+            {
+               f[0] = f[1] = f[2] = f[3] = classes[k];
+               rank = k + 1;
+            }
+          else if (!TILE_WALL_IS(c))
+            {
+               f[0] = c->tile_tl;
+               f[1] = c->tile_tr;
+               f[2] = c->tile_bl;
+               f[3] = c->tile_br;
+               rank = 0;
+            }
+          else
+            continue;
+
+          t.cells[k] = 1;
+          v = (y * t.w) + x;
+          _terrain_vertex_claim(&t, v, f[0], rank);
+          _terrain_vertex_claim(&t, v + 1, f[1], rank);
+          _terrain_vertex_claim(&t, v + t.w, f[2], rank);
+          _terrain_vertex_claim(&t, v + t.w + 1, f[3], rank);
+       }
+
+   if (!_terrain_relax(&t, bands))
+     goto end;
+
+   /*
+    * Cells with a class are all set (their tile is randomized), the others
+    * only if a corner changed. Their state is journaled beforehand, so
+    * the bands do not have to.
+    */
+   vals = t.values[t.cur];
+   for (y = 0, k = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x, ++k)
+       {
+          c = &(ed->cells[y][x]);
+          v = (y * t.w) + x;
+          if (classes[k] != TILE_NONE)
+            write[k] = (TILE_WALL_IS(c)) ? TERRAIN_WRITE_SERIAL
+                                         : TERRAIN_WRITE_BAND;
+          else if ((!TILE_WALL_IS(c)) &&
+                   ((c->tile_tl != vals[v]) || (c->tile_tr != vals[v + 1]) ||
+                    (c->tile_bl != vals[v + t.w]) ||
+                    (c->tile_br != vals[v + t.w + 1])))
+            write[k] = TERRAIN_WRITE_BAND;
+          if (write[k] != TERRAIN_WRITE_NONE)
+            {
+               snapshot_cell_touch(ed, x, y);
+               written++;
+            }
+       }
+
+   t.ed = ed;
+   t.write = write;
+   t.seed = ((uint64_t)prng_next(prng) << 32) | prng_next(prng);
+   parallel_run((map_h + t.band_h - 1) / t.band_h, _terrain_tiles_cb, &t);
+
+   /*
+    * What touches shared state is done on the main thread: walls being
+    * replaced update their neighbours, and units that do not fit their
+    * new tile are removed.
+    */
+   for (y = 0, k = 0; y < map_h; ++y)
+     for (x = 0; x < map_w; ++x, ++k)
+       {
+          if (write[k] == TERRAIN_WRITE_SERIAL)
+            {
+               v = (y * t.w) + x;
+               bitmap_tile_set(ed, x, y, vals[v], vals[v + 1],
+                               vals[v + t.w], vals[v + t.w + 1],
+                               TILE_RANDOMIZE, EINA_TRUE);
+            }
+          else if ((write[k] == TERRAIN_WRITE_BAND) &&
+                   (!cell_unit_below_fits_is(&(ed->cells[y][x]))))
+            bitmap_unit_del_at(ed, x, y, UNIT_BELOW);
+       }
+
+   /* All at once */
+   editor_maps_dirty_all(ed);
+   minimap_reload(ed);
+   minimap_render(ed, 0, 0, map_w, map_h);
+   bitmap_refresh(ed, NULL);
+
+   stats_add(STATS_PROPAGATED_CELLS, written);
+   ok = EINA_TRUE;
+
+end:
+   free(t.values[0]);
+   free(t.values[1]);
+   free(t.ranks[0]);
+   free(t.ranks[1]);
+   free(t.active);
+   free(t.cells);
+   free(t.changes);
+   free(write);
+   return ok;
+}
+
+Eina_Bool
+terrain_repair(Editor       *ed,
+               unsigned int *changed)
+{
+   const unsigned int map_w = ed->pud->map_w;
+   const unsigned int cells = map_w * ed->pud->map_h;
+   uint8_t *frags, *flags, *f;
+   unsigned int k, count = 0;
+   const Cell *c;
+   Eina_Bool ok = EINA_FALSE;
+
+   frags = malloc(cells * 4);
+   flags = calloc(cells, sizeof(uint8_t));
+   if (EINA_UNLIKELY((!frags) || (!flags)))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+   for (k = 0; k < cells; k++)
+     {
+        c = &(ed->cells[k / map_w][k % map_w]);
+        f = &(frags[k * 4]);
+        f[0] = c->tile_tl;
+        f[1] = c->tile_tr;
+        f[2] = c->tile_bl;
+        f[3] = c->tile_br;
+     }
+
+   if (!_terrain_repair(frags, map_w, ed->pud->map_h, flags, &count))
+     goto end;
+
+   for (k = 0; k < cells; k++)
+     {
+        if (!flags[k]) continue;
+        f = &(frags[k * 4]);
+        bitmap_tile_set(ed, k % map_w, k / map_w, f[0], f[1], f[2], f[3],
+                        TILE_RANDOMIZE, EINA_TRUE);
+     }
+   ok = EINA_TRUE;
+
+end:
+   if (changed) *changed = count;
+   free(frags);
+   free(flags);
+   return ok;
+}
+
+Eina_Bool
+terrain_repair_pud(Pud          *pud,
+                   Prng         *prng,
+                   unsigned int *changed)
+{
+   const unsigned int map_w = pud->map_w;
+   const unsigned int cells = map_w * pud->map_h;
+   uint8_t *frags, *flags, *f;
+   unsigned int k, count = 0, unknown = 0;
+   uint8_t seed;
+   Eina_Bool ok = EINA_FALSE;
+
+   frags = calloc(cells * 4, sizeof(uint8_t));
+   flags = calloc(cells, sizeof(uint8_t));
+   if (EINA_UNLIKELY((!frags) || (!flags)))
+     {
+        CRI("Failed to allocate memory");
+        goto end;
+     }
+
+   for (k = 0; k < cells; k++)
+     {
+        f = &(frags[k * 4]);
+        if (!tile_decompose(pud->tiles_map[k],
+                            &f[0], &f[1], &f[2], &f[3], &seed))
+          {
+             /* Left as it is, and does not constrain its neighbours */
+             f[0] = f[1] = f[2] = f[3] = TILE_NONE;
+             unknown++;
+          }
+     }
+   if (unknown > 0)
+     WRN("%u cell(s) have an unknown tile: they are not repaired", unknown);
+
+   if (!_terrain_repair(frags, map_w, pud->map_h, flags, &count))
+     goto end;
+
+   /* Same as syncing an editor, for the repaired cells only */
+   for (k = 0; k < cells; k++)
+     {
+        if (!flags[k]) continue;
+        f = &(frags[k * 4]);
+        pud->tiles_map[k] = tile_calculate(f[0], f[1], f[2], f[3],
+                                           TILE_RANDOMIZE, pud->era, prng);
+        pud->action_map[k] = tile_action_get(f[0], f[1], f[2], f[3]);
+        pud->movement_map[k] = tile_movement_get(f[0], f[1], f[2], f[3]);
+     }
+   ok = EINA_TRUE;
+
+end:
+   if (changed) *changed = count;
+   free(frags);
+   free(flags);
+   return ok;
+}
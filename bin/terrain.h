@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _TERRAIN_H_
+#define _TERRAIN_H_
+
+/*
+ * Batch solver for whole maps (generated or imported terrains).
+ * classes holds one solid fragment per cell (map_w * map_h), or TILE_NONE
+ * for cells that are to be left as they are (they only change if their
+ * neighbours impose on them). The fragments are solved all at once, and
+ * the tiles are computed in parallel, then drawn once. Variants of tiles
+ * are drawn from prng. Returns EINA_FALSE (and nothing is set) if the
+ * fragments could not be solved.
+ */
+Eina_Bool terrain_solve(Editor *ed, const uint8_t *classes, Prng *prng);
+
+/*
+ * Repairs the whole map: incompatible fragments (between cells, or in a
+ * cell) are resolved until none is left. Returns the number of cells
+ * that changed in 'changed'. Walls are not modified.
+ */
+Eina_Bool terrain_repair(Editor *ed, unsigned int *changed);
+
+/*
+ * Same, without editor (e.g. batch cleanup): tiles are written in the pud.
+ * Cells whose tile cannot be decomposed are reported and left as they are.
+ */
+Eina_Bool terrain_repair_pud(Pud *pud, Prng *prng, unsigned int *changed);
+
+#endif /* ! _TERRAIN_H_ */
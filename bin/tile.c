@@ -86,6 +86,41 @@ static const uint8_t _walls_table[] =
    [0xd] = 0b0010,
 };
 
+/*
+ * Fragments, as stored in the cells, are given a 4 bits code. The
+ * composition table is indexed by the codes of the 4 fragments.
+ */
+#define TILE_FRAGMENT_UNKNOWN 0xf
+
+static const uint8_t _fragment_values[] =
+{
+   TILE_NONE,
+   TILE_TREES,
+   TILE_GRASS_LIGHT,
+   TILE_GROUND_LIGHT,
+   TILE_WATER_LIGHT,
+   TILE_WATER_DARK,
+   TILE_GRASS_DARK,
+   TILE_GROUND_DARK,
+   TILE_ROCKS,
+   TILE_HUMAN_WALL,
+   TILE_HUMAN_WALL | TILE_WALL_OPEN,
+   TILE_HUMAN_WALL | TILE_WALL_CLOSED,
+   TILE_ORC_WALL,
+   TILE_ORC_WALL | TILE_WALL_OPEN,
+   TILE_ORC_WALL | TILE_WALL_CLOSED,
+};
+
+#define TILE_FRAGMENTS_PACK(tl, tr, bl, br) \
+   (((uint32_t)(tl) << 24) | ((uint32_t)(tr) << 16) | \
+    ((uint32_t)(bl) << 8) | (uint32_t)(br))
+
+static Eina_Bool _tables_ready = EINA_FALSE;
+static uint8_t _fragment_codes[256];    /* Fragment to code */
+static uint16_t _mask_table[1 << 16];   /* Codes of 4 fragments to mask */
+static uint32_t _decompose_table[1 << 12]; /* Tile without seed to packed
+                                              fragments. 0 if invalid. */
+
 /*============================================================================*
  *                                 Private API                                *
  *============================================================================*/
@@ -163,15 +198,12 @@ _tile_wall_mask_get(uint8_t tl,
 }
 
 
-/*============================================================================*
- *                                 Public API                                 *
- *============================================================================*/
-
-uint16_t
-tile_mask_calculate(uint8_t tl,
-                    uint8_t tr,
-                    uint8_t bl,
-                    uint8_t br)
+static uint16_t
+_tile_mask_compute(uint8_t   tl,
+                   uint8_t   tr,
+                   uint8_t   bl,
+                   uint8_t   br,
+                   Eina_Bool verbose)
 {
    /* Helpers */
 #define TILE_HAS(type) _tile_has_type(tl, tr, bl, br, type)
@@ -201,7 +233,7 @@ tile_mask_calculate(uint8_t tl,
              break;
 
            default:
-              CRI("Unhandled solid tile %x", tl);
+              if (verbose) CRI("Unhandled solid tile %x", tl);
               goto fail;
           }
      }
@@ -223,7 +255,7 @@ tile_mask_calculate(uint8_t tl,
                }
              else
                {
-                  CRI("Invalid disposition of tiles (with grass light)");
+                  if (verbose) CRI("Invalid disposition of tiles (with grass light)");
                   goto fail;
                }
           }
@@ -243,7 +275,7 @@ tile_mask_calculate(uint8_t tl,
                }
              else
                {
-                  CRI("Invalid disposition of tiles (with ground light)");
+                  if (verbose) CRI("Invalid disposition of tiles (with ground light)");
                   goto fail;
                }
           }
@@ -255,7 +287,7 @@ tile_mask_calculate(uint8_t tl,
                }
              else
                {
-                  CRI("Invalid disposition of tiles (with water light)");
+                  if (verbose) CRI("Invalid disposition of tiles (with water light)");
                   goto fail;
                }
           }
@@ -269,7 +301,7 @@ tile_mask_calculate(uint8_t tl,
           }
         else
           {
-             CRI("Uncovered tile disposition");
+             if (verbose) CRI("Uncovered tile disposition");
              goto fail;
           }
      }
@@ -277,8 +309,9 @@ tile_mask_calculate(uint8_t tl,
    return tile;
 
 fail:
-   CRI("Analysis of tile (tl, tr, bl, br) = (0x%02x, 0x%02x, 0x%02x, 0x%02x) failed",
-       tl, tr, bl, br);
+   if (verbose)
+     CRI("Analysis of tile (tl, tr, bl, br) = (0x%02x, 0x%02x, 0x%02x, 0x%02x) failed",
+         tl, tr, bl, br);
    return 0x0000;
 
 #undef LOW_MASK
@@ -286,12 +319,13 @@ fail:
 }
 
 uint16_t
-tile_calculate(uint8_t tl,
-               uint8_t tr,
-               uint8_t bl,
-               uint8_t br,
-               uint8_t seed,
-               Pud_Era era)
+tile_calculate(uint8_t  tl,
+               uint8_t  tr,
+               uint8_t  bl,
+               uint8_t  br,
+               uint8_t  seed,
+               Pud_Era  era,
+               Prng    *prng)
 {
    uint16_t tile_code, rtile;
 
@@ -308,7 +342,7 @@ tile_calculate(uint8_t tl,
              (tile_code & 0x0060)))
           {
              if (!(seed & TILE_SPECIAL))
-               rtile = rand() % 3;
+               rtile = (prng) ? prng_below(prng, 3) : 0;
              else
                {
                   if (rtile <= 2)
@@ -351,21 +385,18 @@ tile_calculate(uint8_t tl,
    return tile_code;
 }
 
-void
-tile_decompose(uint16_t  tile_code,
-               uint8_t  *tl,
-               uint8_t  *tr,
-               uint8_t  *bl,
-               uint8_t  *br,
-               uint8_t  *seed)
+static Eina_Bool
+_tile_decompose_compute(uint16_t   tile_code,
+                        uint8_t   *tl,
+                        uint8_t   *tr,
+                        uint8_t   *bl,
+                        uint8_t   *br,
+                        Eina_Bool  verbose)
 {
    /*
     * FIXME Algo here is sh*t.
     */
 
-   /* Seed is common to all tiles */
-   *seed = (uint8_t)(tile_code & 0x000f);
-
    if ((tile_code & 0xff00) == 0x0000) /* Solid */
      {
         uint8_t code = TILE_NONE;
@@ -383,7 +414,9 @@ tile_decompose(uint16_t  tile_code,
            case 0x00b0: code = TILE_HUMAN_WALL | TILE_WALL_OPEN; break;
            case 0x00a0: code = TILE_ORC_WALL | TILE_WALL_CLOSED; break;
            case 0x00c0: code = TILE_ORC_WALL | TILE_WALL_OPEN; break;
-           default: CRI("Unhandled tile: 0x%04x", tile_code); return;
+           default:
+              if (verbose) CRI("Unhandled tile: 0x%04x", tile_code);
+              return EINA_FALSE;
           }
         *bl = code; *br = code; *tl = code; *tr = code;
      }
@@ -415,9 +448,10 @@ tile_decompose(uint16_t  tile_code,
              pair[1] = TILE_WATER_DARK;   pair[0] = TILE_WATER_LIGHT; break;
 
            default:
-             CRI("Invalid tile 0x%04x (unhandled master 0x%04x)",
-                 tile_code, master);
-             return;
+             if (verbose)
+               CRI("Invalid tile 0x%04x (unhandled master 0x%04x)",
+                   tile_code, master);
+             return EINA_FALSE;
           }
 
         /* Walls */
@@ -427,8 +461,8 @@ tile_decompose(uint16_t  tile_code,
              uint8_t val;
              if (EINA_UNLIKELY(key > 0xd))
                {
-                  CRI("Invalid wall spread 0x%04x", spread);
-                  return;
+                  if (verbose) CRI("Invalid wall spread 0x%04x", spread);
+                  return EINA_FALSE;
                }
 
              val = _walls_table[key];
@@ -473,12 +507,218 @@ tile_decompose(uint16_t  tile_code,
                    *tl = pair[0]; *tr = pair[1]; *bl = pair[1]; *br = pair[0]; break;
 
                 default:
-                   CRI("Invalid tile 0x%04x (unhandled spread 0x%04x)",
-                       tile_code, spread);
-                   return;
+                   if (verbose)
+                     CRI("Invalid tile 0x%04x (unhandled spread 0x%04x)",
+                         tile_code, spread);
+                   return EINA_FALSE;
                }
           }
      }
+
+   return EINA_TRUE;
+}
+
+static inline unsigned int
+_tile_mask_key(uint8_t tl,
+               uint8_t tr,
+               uint8_t bl,
+               uint8_t br)
+{
+   return ((unsigned int)_fragment_codes[tl] << 12) |
+          ((unsigned int)_fragment_codes[tr] << 8) |
+          ((unsigned int)_fragment_codes[bl] << 4) |
+          ((unsigned int)_fragment_codes[br]);
+}
+
+static inline Eina_Bool
+_tile_mask_key_valid_is(unsigned int key)
+{
+   /* None of the fragments is unknown */
+   return (((key & 0xf000) != 0xf000) && ((key & 0x0f00) != 0x0f00) &&
+           ((key & 0x00f0) != 0x00f0) && ((key & 0x000f) != 0x000f));
+}
+
+
+/*============================================================================*
+ *                                Init/Shutdown                               *
+ *============================================================================*/
+
+Eina_Bool
+tile_tables_init(void)
+{
+   unsigned int key, code;
+   uint8_t tl, tr, bl, br;
+
+   if (_tables_ready) return EINA_TRUE;
+
+   memset(_fragment_codes, TILE_FRAGMENT_UNKNOWN, sizeof(_fragment_codes));
+   for (code = 0; code < EINA_C_ARRAY_LENGTH(_fragment_values); ++code)
+     _fragment_codes[_fragment_values[code]] = code;
+
+   /* Composition: every combination of the known fragments */
+   for (key = 0; key < EINA_C_ARRAY_LENGTH(_mask_table); ++key)
+     {
+        if (!_tile_mask_key_valid_is(key))
+          continue;
+        _mask_table[key] = _tile_mask_compute(_fragment_values[(key >> 12) & 0xf],
+                                              _fragment_values[(key >> 8) & 0xf],
+                                              _fragment_values[(key >> 4) & 0xf],
+                                              _fragment_values[key & 0xf],
+                                              EINA_FALSE);
+     }
+
+   /* Decomposition: the seed (low nibble) does not change the fragments */
+   for (code = 0; code < EINA_C_ARRAY_LENGTH(_decompose_table); ++code)
+     {
+        if (_tile_decompose_compute(code << 4, &tl, &tr, &bl, &br, EINA_FALSE))
+          _decompose_table[code] = TILE_FRAGMENTS_PACK(tl, tr, bl, br);
+        else
+          _decompose_table[code] = 0;
+     }
+
+   _tables_ready = EINA_TRUE;
+   return EINA_TRUE;
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+uint16_t
+tile_mask_calculate(uint8_t tl,
+                    uint8_t tr,
+                    uint8_t bl,
+                    uint8_t br)
+{
+   unsigned int key;
+   uint16_t mask;
+
+   if (EINA_LIKELY(_tables_ready))
+     {
+        key = _tile_mask_key(tl, tr, bl, br);
+        if (_tile_mask_key_valid_is(key))
+          {
+             mask = _mask_table[key];
+             /* 0 is an error: let the computation report it */
+             if (EINA_LIKELY(mask != 0x0000))
+               return mask;
+          }
+     }
+   return _tile_mask_compute(tl, tr, bl, br, EINA_TRUE);
+}
+
+Eina_Bool
+tile_decompose(uint16_t  tile_code,
+               uint8_t  *tl,
+               uint8_t  *tr,
+               uint8_t  *bl,
+               uint8_t  *br,
+               uint8_t  *seed)
+{
+   uint32_t packed;
+
+   /* Seed is common to all tiles */
+   *seed = (uint8_t)(tile_code & 0x000f);
+
+   if (EINA_LIKELY(_tables_ready))
+     {
+        packed = _decompose_table[tile_code >> 4];
+        if (EINA_LIKELY(packed != 0))
+          {
+             *tl = (packed >> 24) & 0xff;
+             *tr = (packed >> 16) & 0xff;
+             *bl = (packed >> 8) & 0xff;
+             *br = packed & 0xff;
+             return EINA_TRUE;
+          }
+     }
+
+   /* Invalid codes are reported, and fragments are not modified */
+   return _tile_decompose_compute(tile_code, tl, tr, bl, br, EINA_TRUE);
+}
+
+Eina_Bool
+tile_benchmark(void)
+{
+   const unsigned int loops = 16;
+   unsigned int key, code, i, errors = 0;
+   uint8_t f[4], tl, tr, bl, br, seed, rtl, rtr, rbl, rbr;
+   uint16_t ref, got;
+   volatile uint32_t sink = 0;
+   double start, t_ref, t_lut;
+   Eina_Bool valid;
+
+   tile_tables_init();
+
+   /*
+    * Equivalence: every combination of 4 known fragments, and every
+    * tile code. Unknown fragments never hit the tables.
+    */
+   for (key = 0; key < (1 << 16); ++key)
+     {
+        if (!_tile_mask_key_valid_is(key)) continue;
+        f[0] = _fragment_values[(key >> 12) & 0xf];
+        f[1] = _fragment_values[(key >> 8) & 0xf];
+        f[2] = _fragment_values[(key >> 4) & 0xf];
+        f[3] = _fragment_values[key & 0xf];
+        ref = _tile_mask_compute(f[0], f[1], f[2], f[3], EINA_FALSE);
+        got = _mask_table[_tile_mask_key(f[0], f[1], f[2], f[3])];
+        if (ref != got)
+          {
+             ERR("Mask of (0x%02x, 0x%02x, 0x%02x, 0x%02x): 0x%04x instead of 0x%04x",
+                 f[0], f[1], f[2], f[3], got, ref);
+             errors++;
+          }
+     }
+   for (code = 0; code < (1 << 16); ++code)
+     {
+        rtl = rtr = rbl = rbr = 0;
+        valid = _tile_decompose_compute(code, &rtl, &rtr, &rbl, &rbr, EINA_FALSE);
+        tl = tr = bl = br = 0;
+        if (valid)
+          tile_decompose(code, &tl, &tr, &bl, &br, &seed);
+        else if (_decompose_table[code >> 4] != 0)
+          {
+             ERR("Tile 0x%04x is invalid but has a decomposition", code);
+             errors++;
+             continue;
+          }
+        if ((tl != rtl) || (tr != rtr) || (bl != rbl) || (br != rbr))
+          {
+             ERR("Decomposition of 0x%04x does not match", code);
+             errors++;
+          }
+     }
+   printf("tile: %u mismatches\n", errors);
+
+   /* Timings, on the valid inputs only (errors are logged) */
+   start = ecore_time_get();
+   for (i = 0; i < loops; ++i)
+     for (code = 0x0010; code < 0x0a00; ++code)
+       if (_decompose_table[code >> 4])
+         {
+            _tile_decompose_compute(code, &tl, &tr, &bl, &br, EINA_FALSE);
+            sink += _tile_mask_compute(tl, tr, bl, br, EINA_FALSE);
+         }
+   t_ref = ecore_time_get() - start;
+
+   start = ecore_time_get();
+   for (i = 0; i < loops; ++i)
+     for (code = 0x0010; code < 0x0a00; ++code)
+       if (_decompose_table[code >> 4])
+         {
+            tile_decompose(code, &tl, &tr, &bl, &br, &seed);
+            sink += tile_mask_calculate(tl, tr, bl, br);
+         }
+   t_lut = ecore_time_get() - start;
+
+   printf("tile: branches %8.3f ms\n", t_ref * 1000.0);
+   printf("tile: tables   %8.3f ms (x%.2f)\n", t_lut * 1000.0,
+          (t_lut > 0.0) ? t_ref / t_lut : 0.0);
+   (void) sink;
+
+   return (errors == 0);
 }
 
 Eina_Bool
@@ -258,13 +258,21 @@ tile_wall_has(uint8_t tl,
    return ((tl & mask) || (tr & mask) || (bl & mask) || (br & mask));
 }
 
+Eina_Bool tile_tables_init(void);
+Eina_Bool tile_benchmark(void);
+
+/*
+ * prng picks the variants of TILE_RANDOMIZE seeds. If NULL, the first
+ * variant of the special tiles is used.
+ */
 uint16_t
-tile_calculate(uint8_t tl,
-               uint8_t tr,
-               uint8_t bl,
-               uint8_t br,
-               uint8_t seed,
-               Pud_Era era);
+tile_calculate(uint8_t  tl,
+               uint8_t  tr,
+               uint8_t  bl,
+               uint8_t  br,
+               uint8_t  seed,
+               Pud_Era  era,
+               Prng    *prng);
 
 uint16_t
 tile_mask_calculate(uint8_t tl,
@@ -272,7 +280,8 @@ tile_mask_calculate(uint8_t tl,
                     uint8_t bl,
                     uint8_t br);
 
-void
+/* Returns EINA_FALSE (fragments are not modified) for invalid codes */
+Eina_Bool
 tile_decompose(uint16_t  tile_code,
                uint8_t  *tl,
                uint8_t  *tr,
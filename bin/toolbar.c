@@ -40,7 +40,7 @@ enum
    SN, SC, SS, /* spreads */
    RS, RM, RB, /* radius */
    TL, TD, /* tints */
-   AS, AW, AN, AC, AT, AR, AH, AO /* actions */
+   AS, AW, AN, AC, AT, AR, AH, AO, AF /* actions */
 };
 
 /* Used to avoid to manage dynamic memory allocation for every single
@@ -65,7 +65,8 @@ static const uint16_t _selections[] = {
    [AT] = EDITOR_SEL_ACTION_TREES,
    [AR] = EDITOR_SEL_ACTION_ROCKS,
    [AH] = EDITOR_SEL_ACTION_HUMAN_WALLS,
-   [AO] = EDITOR_SEL_ACTION_ORC_WALLS
+   [AO] = EDITOR_SEL_ACTION_ORC_WALLS,
+   [AF] = EDITOR_SEL_ACTION_FILL
 };
 
 
@@ -122,12 +123,39 @@ _seg_changed_cb(void        *data,
    bitmap_cursor_visibility_set(ed, EINA_TRUE);
    bitmap_cursor_size_set(ed, 1, 1);
 
+   /* Remember the terrain to fill with */
+   switch (editor_sel_action_get(ed))
+     {
+      case EDITOR_SEL_ACTION_WATER:
+      case EDITOR_SEL_ACTION_GROUND:
+      case EDITOR_SEL_ACTION_GRASS:
+      case EDITOR_SEL_ACTION_TREES:
+      case EDITOR_SEL_ACTION_ROCKS:
+         ed->fill_action = editor_sel_action_get(ed);
+         break;
+
+      default:
+         break;
+     }
+
    switch (editor_sel_action_get(ed))
      {
       case EDITOR_SEL_ACTION_SELECTION:
          bitmap_cursor_visibility_set(ed, EINA_FALSE);
          break;
 
+      case EDITOR_SEL_ACTION_FILL:
+         /* Fills with the last terrain selected: only its tint matters */
+         elm_object_disabled_set(ed->segs[SEG_RADIUS], EINA_TRUE);
+         elm_object_disabled_set(ed->segs[SEG_SPREAD], EINA_TRUE);
+         if ((ed->fill_action == EDITOR_SEL_ACTION_TREES) ||
+             (ed->fill_action == EDITOR_SEL_ACTION_ROCKS))
+           {
+              editor_sel_tint_set(ed, EDITOR_SEL_TINT_LIGHT);
+              elm_object_disabled_set(ed->segs[SEG_TINT], EINA_TRUE);
+           }
+         break;
+
       case EDITOR_SEL_ACTION_ORC_WALLS:
       case EDITOR_SEL_ACTION_HUMAN_WALLS:
          editor_sel_radius_set(ed, EDITOR_SEL_RADIUS_SMALL);
@@ -270,7 +298,8 @@ toolbar_add(Editor      *ed,
    SEG_IT_ADD(ed->segs[SEG_ACTION], "rocks.png", AR);
    SEG_IT_ADD(ed->segs[SEG_ACTION], "human_walls.png", AH);
    SEG_IT_ADD(ed->segs[SEG_ACTION], "orc_walls.png", AO);
-   _segment_size_autoset(ed->segs[SEG_ACTION], 8);
+   SEG_IT_ADD(ed->segs[SEG_ACTION], "fill.png", AF);
+   _segment_size_autoset(ed->segs[SEG_ACTION], 9);
 
    /* Always select the first item */
    for (i = 0; i < EINA_C_ARRAY_LENGTH(ed->segs); i++)
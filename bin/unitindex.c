@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "war2edit.h"
+
+/* Size of the buckets, in cells */
+#define UNITINDEX_BUCKET 8
+
+/* Units are registered per anchor and per layer (below, above, start) */
+#define UNITINDEX_LAYERS 3
+
+/* Cells a sprite may overflow the footprint of its unit by */
+#define UNITINDEX_MARGIN 1
+
+struct _Unitindex_Entry
+{
+   Eina_Rectangle bbox;  /* Cells covered by the sprite */
+   unsigned int   x;
+   unsigned int   y;
+   unsigned int   stamp; /* Last query the entry was visited by */
+   Unit           type;
+};
+
+/*============================================================================*
+ *                                 Private API                                *
+ *============================================================================*/
+
+static inline unsigned int
+_unitindex_slot(const Editor *ed,
+                unsigned int  x,
+                unsigned int  y,
+                Unit          type)
+{
+   return (((y * ed->unitindex.map_w) + x) * UNITINDEX_LAYERS) + (type - 1);
+}
+
+static Eina_Bool
+_unitindex_type_valid_is(Unit type)
+{
+   return ((type == UNIT_BELOW) ||
+           (type == UNIT_ABOVE) ||
+           (type == UNIT_START_LOCATION));
+}
+
+/*
+ * Cells the sprite of a unit may cover. Sprites are centered on the
+ * footprint of their unit, and never overflow it by a whole cell (once
+ * the pixel lost when rounding mipmaps down is added), so they don't have
+ * to be decoded to be measured.
+ */
+static void
+_unitindex_bbox_calc(const Editor   *ed,
+                     unsigned int    x,
+                     unsigned int    y,
+                     Unit            type,
+                     Eina_Rectangle *bbox)
+{
+   const Cell *const c = &(ed->cells[y][x]);
+   unsigned int w, h;
+   int x1, y1, x2, y2;
+
+   switch (type)
+     {
+      case UNIT_BELOW:
+         w = c->spread_x_below;
+         h = c->spread_y_below;
+         break;
+
+      case UNIT_ABOVE:
+         w = c->spread_x_above;
+         h = c->spread_y_above;
+         break;
+
+      default:
+         w = 1;
+         h = 1;
+         break;
+     }
+
+   x1 = (int)x - UNITINDEX_MARGIN;
+   y1 = (int)y - UNITINDEX_MARGIN;
+   x2 = (int)(x + w) + UNITINDEX_MARGIN;
+   y2 = (int)(y + h) + UNITINDEX_MARGIN;
+   if (x1 < 0) x1 = 0;
+   if (y1 < 0) y1 = 0;
+   if ((unsigned int)x2 > ed->pud->map_w) x2 = ed->pud->map_w;
+   if ((unsigned int)y2 > ed->pud->map_h) y2 = ed->pud->map_h;
+
+   EINA_RECTANGLE_SET(bbox, x1, y1, x2 - x1, y2 - y1);
+}
+
+static void
+_unitindex_buckets_get(const Editor         *ed,
+                       const Eina_Rectangle *zone,
+                       unsigned int         *bx1,
+                       unsigned int         *by1,
+                       unsigned int         *bx2,
+                       unsigned int         *by2)
+{
+   const int x2 = zone->x + zone->w;
+   const int y2 = zone->y + zone->h;
+
+   *bx1 = (zone->x < 0) ? 0 : zone->x / UNITINDEX_BUCKET;
+   *by1 = (zone->y < 0) ? 0 : zone->y / UNITINDEX_BUCKET;
+   *bx2 = (x2 <= 0) ? 0 : (x2 + UNITINDEX_BUCKET - 1) / UNITINDEX_BUCKET;
+   *by2 = (y2 <= 0) ? 0 : (y2 + UNITINDEX_BUCKET - 1) / UNITINDEX_BUCKET;
+   if (*bx2 > ed->unitindex.cols) *bx2 = ed->unitindex.cols;
+   if (*by2 > ed->unitindex.rows) *by2 = ed->unitindex.rows;
+}
+
+static int
+_unitindex_layer_get(Unit type)
+{
+   /* Start locations are drawn first, then units below, then above */
+   return (type == UNIT_START_LOCATION) ? 0 : (int)type;
+}
+
+static int
+_unitindex_cmp(const void *a,
+               const void *b)
+{
+   const Unitindex_Entry *const e1 = *(Unitindex_Entry *const *)a;
+   const Unitindex_Entry *const e2 = *(Unitindex_Entry *const *)b;
+   const int l1 = _unitindex_layer_get(e1->type);
+   const int l2 = _unitindex_layer_get(e2->type);
+
+   int order;
+
+   if (l1 != l2) return l1 - l2;
+
+   /* Raster order: an anchor holds a single unit per layer */
+   if (e1->y != e2->y) order = (e1->y < e2->y) ? -1 : 1;
+   else if (e1->x != e2->x) order = (e1->x < e2->x) ? -1 : 1;
+   else return 0;
+
+   /*
+    * Within a layer, the order is the one the map used to be scanned in:
+    * start locations from the top-left corner, units from the bottom-right
+    * one. Overlapping sprites are then stacked as they used to be.
+    */
+   return (l1 == 0) ? order : -order;
+}
+
+static void
+_unitindex_clear(Editor *ed)
+{
+   unsigned int i, count;
+
+   if (ed->unitindex.units)
+     {
+        count = ed->unitindex.map_w * ed->unitindex.map_h * UNITINDEX_LAYERS;
+        for (i = 0; i < count; ++i)
+          free(ed->unitindex.units[i]);
+        free(ed->unitindex.units);
+        ed->unitindex.units = NULL;
+     }
+   if (ed->unitindex.buckets)
+     {
+        count = ed->unitindex.cols * ed->unitindex.rows;
+        for (i = 0; i < count; ++i)
+          eina_list_free(ed->unitindex.buckets[i]);
+        free(ed->unitindex.buckets);
+        ed->unitindex.buckets = NULL;
+     }
+   ed->unitindex.cols = 0;
+   ed->unitindex.rows = 0;
+   ed->unitindex.map_w = 0;
+   ed->unitindex.map_h = 0;
+}
+
+
+/*============================================================================*
+ *                                 Public API                                 *
+ *============================================================================*/
+
+Eina_Bool
+unitindex_reset(Editor *ed)
+{
+   unsigned int map_w, map_h;
+
+   EINA_SAFETY_ON_NULL_RETURN_VAL(ed, EINA_FALSE);
+
+   map_w = ed->pud->map_w;
+   map_h = ed->pud->map_h;
+   _unitindex_clear(ed);
+
+   if (!ed->unitindex.visible)
+     {
+        ed->unitindex.visible = eina_inarray_new(sizeof(Unitindex_Entry *), 64);
+        if (EINA_UNLIKELY(!ed->unitindex.visible))
+          {
+             CRI("Failed to create array");
+             return EINA_FALSE;
+          }
+     }
+
+   ed->unitindex.units = calloc(map_w * map_h * UNITINDEX_LAYERS,
+                                sizeof(Unitindex_Entry *));
+   if (EINA_UNLIKELY(!ed->unitindex.units))
+     {
+        CRI("Failed to allocate memory");
+        goto fail;
+     }
+   ed->unitindex.map_w = map_w;
+   ed->unitindex.map_h = map_h;
+
+   ed->unitindex.cols = (map_w + UNITINDEX_BUCKET - 1) / UNITINDEX_BUCKET;
+   ed->unitindex.rows = (map_h + UNITINDEX_BUCKET - 1) / UNITINDEX_BUCKET;
+   ed->unitindex.buckets = calloc(ed->unitindex.cols * ed->unitindex.rows,
+                                  sizeof(Eina_List *));
+   if (EINA_UNLIKELY(!ed->unitindex.buckets))
+     {
+        CRI("Failed to allocate memory");
+        goto fail;
+     }
+
+   return EINA_TRUE;
+
+fail:
+   _unitindex_clear(ed);
+   return EINA_FALSE;
+}
+
+void
+unitindex_free(Editor *ed)
+{
+   EINA_SAFETY_ON_NULL_RETURN(ed);
+
+   _unitindex_clear(ed);
+   if (ed->unitindex.visible)
+     {
+        eina_inarray_free(ed->unitindex.visible);
+        ed->unitindex.visible = NULL;
+     }
+}
+
+void
+unitindex_rebuild(Editor *ed)
+{
+   unsigned int i, j;
+   const Cell *c;
+
+   EINA_SAFETY_ON_NULL_RETURN(ed);
+
+   if (!unitindex_reset(ed))
+     return;
+
+   for (j = 0; j < ed->pud->map_h; ++j)
+     for (i = 0; i < ed->pud->map_w; ++i)
+       {
+          c = &(ed->cells[j][i]);
+          if (c->start_location != CELL_NOT_START_LOCATION)
+            unitindex_add(ed, i, j, UNIT_START_LOCATION);
+          if (c->anchor_below)
+            unitindex_add(ed, i, j, UNIT_BELOW);
+          if (c->anchor_above)
+            unitindex_add(ed, i, j, UNIT_ABOVE);
+       }
+}
+
+void
+unitindex_add(Editor       *ed,
+              unsigned int  x,
+              unsigned int  y,
+              Unit          type)
+{
+   Unitindex_Entry *e;
+   unsigned int bx1, by1, bx2, by2, i, j;
+   Eina_List **bucket;
+
+   if (EINA_UNLIKELY(!ed->unitindex.units)) return;
+   EINA_SAFETY_ON_FALSE_RETURN(_unitindex_type_valid_is(type));
+   EINA_SAFETY_ON_TRUE_RETURN((x >= ed->unitindex.map_w) ||
+                              (y >= ed->unitindex.map_h));
+
+   /* The unit may have changed (e.g. its owner): register it again */
+   unitindex_del(ed, x, y, type);
+
+   e = malloc(sizeof(*e));
+   if (EINA_UNLIKELY(!e))
+     {
+        CRI("Failed to allocate memory");
+        return;
+     }
+   e->x = x;
+   e->y = y;
+   e->type = type;
+   e->stamp = ed->unitindex.stamp;
+   _unitindex_bbox_calc(ed, x, y, type, &(e->bbox));
+
+   _unitindex_buckets_get(ed, &(e->bbox), &bx1, &by1, &bx2, &by2);
+   for (j = by1; j < by2; ++j)
+     for (i = bx1; i < bx2; ++i)
+       {
+          bucket = &(ed->unitindex.buckets[(j * ed->unitindex.cols) + i]);
+          *bucket = eina_list_prepend(*bucket, e);
+       }
+
+   ed->unitindex.units[_unitindex_slot(ed, x, y, type)] = e;
+}
+
+void
+unitindex_del(Editor       *ed,
+              unsigned int  x,
+              unsigned int  y,
+              Unit          type)
+{
+   Unitindex_Entry *e;
+   unsigned int bx1, by1, bx2, by2, i, j, slot;
+   Eina_List **bucket;
+
+   if (EINA_UNLIKELY(!ed->unitindex.units)) return;
+   if ((!_unitindex_type_valid_is(type)) ||
+       (x >= ed->unitindex.map_w) || (y >= ed->unitindex.map_h))
+     return;
+
+   slot = _unitindex_slot(ed, x, y, type);
+   e = ed->unitindex.units[slot];
+   if (!e) return;
+
+   _unitindex_buckets_get(ed, &(e->bbox), &bx1, &by1, &bx2, &by2);
+   for (j = by1; j < by2; ++j)
+     for (i = bx1; i < bx2; ++i)
+       {
+          bucket = &(ed->unitindex.buckets[(j * ed->unitindex.cols) + i]);
+          *bucket = eina_list_remove(*bucket, e);
+       }
+
+   ed->unitindex.units[slot] = NULL;
+   free(e);
+}
+
+Eina_Bool
+unitindex_bbox_get(const Editor   *ed,
+                   unsigned int    x,
+                   unsigned int    y,
+                   Unit            type,
+                   Eina_Rectangle *bbox)
+{
+   const Unitindex_Entry *e;
+
+   if ((!ed->unitindex.units) || (!_unitindex_type_valid_is(type)) ||
+       (x >= ed->unitindex.map_w) || (y >= ed->unitindex.map_h))
+     return EINA_FALSE;
+
+   e = ed->unitindex.units[_unitindex_slot(ed, x, y, type)];
+   if (!e) return EINA_FALSE;
+
+   *bbox = e->bbox;
+   return EINA_TRUE;
+}
+
+void
+unitindex_foreach(Editor               *ed,
+                  const Eina_Rectangle *zone,
+                  Unitindex_Cb          cb,
+                  void                 *data)
+{
+   Eina_Inarray *const visible = ed->unitindex.visible;
+   Unitindex_Entry *e, **itr;
+   unsigned int bx1, by1, bx2, by2, i, j, stamp;
+   Eina_List *l;
+
+   EINA_SAFETY_ON_NULL_RETURN(zone);
+   EINA_SAFETY_ON_NULL_RETURN(cb);
+
+   if (EINA_UNLIKELY(!ed->unitindex.buckets)) return;
+
+   /* Units spread over several buckets must be collected only once */
+   stamp = ++ed->unitindex.stamp;
+
+   _unitindex_buckets_get(ed, zone, &bx1, &by1, &bx2, &by2);
+   for (j = by1; j < by2; ++j)
+     for (i = bx1; i < bx2; ++i)
+       {
+          EINA_LIST_FOREACH(ed->unitindex.buckets[(j * ed->unitindex.cols) + i], l, e)
+            {
+               if (e->stamp == stamp) continue;
+               e->stamp = stamp;
+               if (eina_rectangles_intersect(&(e->bbox), zone))
+                 eina_inarray_push(visible, &e);
+            }
+       }
+
+   /* Same back-to-front order than scanning the whole map */
+   eina_inarray_sort(visible, _unitindex_cmp);
+   EINA_INARRAY_FOREACH(visible, itr)
+     cb(data, (*itr)->x, (*itr)->y, (*itr)->type);
+   eina_inarray_flush(visible);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2015-2016 Jean Guyomarc'h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _UNITINDEX_H_
+#define _UNITINDEX_H_
+
+/*
+ * Spatial index of the units. Units are registered by their anchor
+ * (top-left cell), with the cells their sprite may cover, in buckets of
+ * cells. This allows to find which units have to be drawn in a zone,
+ * and which zone a unit requires to be drawn.
+ */
+
+typedef struct _Unitindex_Entry Unitindex_Entry;
+
+typedef void (*Unitindex_Cb)(void *data, unsigned int x, unsigned int y, Unit type);
+
+Eina_Bool unitindex_reset(Editor *ed);
+void unitindex_free(Editor *ed);
+void unitindex_rebuild(Editor *ed);
+void unitindex_add(Editor *ed, unsigned int x, unsigned int y, Unit type);
+void unitindex_del(Editor *ed, unsigned int x, unsigned int y, Unit type);
+Eina_Bool unitindex_bbox_get(const Editor *ed, unsigned int x, unsigned int y,
+                             Unit type, Eina_Rectangle *bbox);
+void unitindex_foreach(Editor *ed, const Eina_Rectangle *zone,
+                       Unitindex_Cb cb, void *data);
+
+#endif /* ! _UNITINDEX_H_ */
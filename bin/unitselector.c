@@ -106,8 +106,10 @@ _radio_cb(void        *data,
 {
    Udata *const u = data;
    Pud_Player sel, old;
+   unsigned int ax, ay;
 
    snapshot_push(u->ed);
+   snapshot_cell_touch(u->ed, u->x, u->y);
    sel = elm_radio_value_get(obj);
    switch (u->type)
      {
@@ -138,6 +140,9 @@ _radio_cb(void        *data,
 
         editor_unit_unref(u->ed, u->x, u->y, u->type);
         editor_unit_ref(u->ed, u->x, u->y, u->type);
+        if (cell_anchor_pos_get(u->ed->cells, u->x, u->y, &ax, &ay,
+                                (u->type != UNIT_ABOVE)))
+          unitindex_add(u->ed, ax, ay, u->type);
 
         elm_layout_text_set(u->lay, "war2edit.unitselector.name",
                             pud_unit_to_string(u->unit, PUD_TRUE));
@@ -199,7 +204,10 @@ _res_edit_cb(void        *data,
    else
      {
         DBG("Resource value is %lu", res);
+        snapshot_push(u->ed);
+        snapshot_cell_touch(u->ed, u->x, u->y);
         u->c->alter_below = res / 2500;
+        snapshot_push_done(u->ed);
      }
 }
 
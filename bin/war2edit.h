@@ -33,6 +33,7 @@
 
 typedef struct _Cell Cell;
 typedef struct _Editor Editor;
+typedef struct _Chunk Chunk;
 
 typedef enum
 {
@@ -46,20 +47,57 @@ typedef enum
 typedef struct
 {
    Evas_Object *clip;
-   Evas_Image *img;
+   Evas_Object *grid; /* Holds the images of the chunks */
+   Evas_Object *events;
 
-   cairo_surface_t *surf;
-   cairo_t *cr;
+   cairo_t *cr; /* Context of the chunk being drawn */
 
    int x_off;
    int y_off;
 
+   unsigned int zoom; /* Level of the atlases mipmaps. 0 is 32px cells */
    int cell_w;
    int cell_h;
    int max_w;
    int max_h;
 
-   unsigned char *pixels;
+   struct {
+      Chunk        *items;
+      unsigned int  cols;
+      unsigned int  rows;
+      Eina_Inlist  *lru; /* Resident chunks */
+      size_t        bytes;
+      size_t        budget;
+   } chunks;
+
+   /*
+    * Terrain layer (one surface per chunk). It caches the tiles of the
+    * map, so they are re-drawn only when the tile of a cell actually
+    * changes. Units and selections are composited over it.
+    */
+   struct {
+      uint16_t *tiles; /* Tile drawn for each cell */
+      Pud_Era era;
+   } terrain;
+
+   /* Tile propagation worklist */
+   struct {
+      uint32_t     *fifo;    /* Ring buffer of cells (y * map_w + x) */
+      uint8_t      *pending; /* Per cell: directions to propagate to, 0 if not queued */
+      unsigned int  head;
+      unsigned int  count;
+   } propagation;
+
+   /*
+    * Refreshes requested within a frame (e.g. by a brush stroke) are
+    * merged, and drawn at once when the next frame is about to start.
+    */
+   struct {
+      Eina_Rectangle  zone;
+      Ecore_Animator *animator;
+      unsigned int    requests;
+      Eina_Bool       full;
+   } pending;
 
    int cx, cy, cw, ch;
    Eina_Bool cursor_enabled;
@@ -74,16 +112,25 @@ const char *main_edje_file_get(void);
 #include "str.h"
 #include "plugins.h"
 #include "log.h"
+#include "prng.h"
+#include "stats.h"
 #include "tile.h"
 #include "atlas.h"
+#include "blit.h"
+#include "parallel.h"
 #include "mainconfig.h"
 #include "toolbar.h"
 #include "cell.h"
+#include "codec.h"
 #include "snapshot.h"
 #include "menu.h"
 #include "sprite.h"
 #include "bitmap.h"
+#include "chunk.h"
 #include "minimap.h"
+#include "damage.h"
+#include "unitindex.h"
+#include "terrain.h"
 #include "editor.h"
 #include "unitselector.h"
 #include "sel.h"
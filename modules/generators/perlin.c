@@ -87,19 +87,29 @@ perlin2d(unsigned int x,
     return fin/div;
 }
 
+/* Splitmix32: the pool only depends on the seed of the generator */
+static uint32_t
+perlin_random(uint32_t *state)
+{
+   uint32_t z = (*state += 0x9e3779b9);
+   z = (z ^ (z >> 16)) * 0x85ebca6b;
+   z = (z ^ (z >> 13)) * 0xc2b2ae35;
+   return z ^ (z >> 16);
+}
+
 static void
-perlin_reconfigure(void)
+perlin_reconfigure(uint32_t seed)
 {
    unsigned int i;
    for (i = 0; i < POOL_SIZE; i++)
-     _random_pool[i] = rand() % 255;
+     _random_pool[i] = perlin_random(&seed) % 255;
+   _seed = perlin_random(&seed) % POOL_SIZE;
 }
 
 static Eina_Bool
 perlin_init(void)
 {
    if (eina_init() <= 0) return EINA_FALSE;
-   perlin_reconfigure();
 
    return EINA_TRUE;
 }
@@ -119,12 +129,13 @@ extern float *
 generator(unsigned int width,
           unsigned int height,
           float        freq,
-          unsigned int depth)
+          unsigned int depth,
+          uint32_t     seed)
 {
    unsigned int i, j, k = 0;
    float *arr;
 
-   _seed = rand();
+   perlin_reconfigure(seed);
 
    arr = malloc(width * height * sizeof(*arr));
    if (EINA_UNLIKELY(!arr))